@@ -0,0 +1,226 @@
+//
+//  BlueBasic_Transfer.c
+//  BlueBasic
+//
+//  File transfer service. Streams a flashstore file to a client as a sequence of notifications.
+//  The client enables notifications on the data characteristic and writes <name:1>[<offset:2>] to the
+//  control characteristic to start (or resume) sending file "name" from the given byte offset.
+//  Each notification is <offset:2><data:1-18>. After the last data the service sends <0xFFFF:2><length:2><crc:2>
+//  where the CRC is a CRC-16/CCITT (0xFFFF start) of the whole file. Writing any other name stops a transfer,
+//  as does turning off notifications or dropping the connection.
+//  All values are little-endian.
+//
+//  This is shared with the simulator, which provides the few stack calls it needs.
+//
+
+#include "os.h"
+
+#ifdef ENABLE_FILE_TRANSFER
+
+#ifdef TARGET_CC254X
+
+#include "gatt_uuid.h"
+
+#define transfer_primary_service_uuid     primaryServiceUUID
+#define transfer_characteristic_uuid      characterUUID
+#define transfer_client_config_uuid       clientCharCfgUUID
+
+#else // TARGET_CC254X
+
+static const unsigned char transfer_primary_service_uuid[] = { 0x00, 0x28 };
+static const unsigned char transfer_characteristic_uuid[] = { 0x03, 0x28 };
+static const unsigned char transfer_client_config_uuid[] = { 0x02, 0x29 };
+
+#endif // TARGET_CC254X
+
+static const unsigned char transferProfileServUUID[] = { 0x3B, 0xA7, 0xBD, 0x64, 0x0a, 0xF7, 0xA3, 0xB5, 0x8D, 0x44, 0x16, 0x16, 0x91, 0x9E, 0xFB, 0x25 };
+static const gattAttrType_t transferProfileService = { ATT_UUID_SIZE, transferProfileServUUID };
+static const unsigned char transferControlUUID[] = { 0x3C, 0xA7, 0xBD, 0x64, 0x0a, 0xF7, 0xA3, 0xB5, 0x8D, 0x44, 0x16, 0x16, 0x91, 0x9E, 0xFB, 0x25 };
+static const unsigned char transferControlProps = GATT_PROP_WRITE;
+static const unsigned char transferDataUUID[] = { 0x3D, 0xA7, 0xBD, 0x64, 0x0a, 0xF7, 0xA3, 0xB5, 0x8D, 0x44, 0x16, 0x16, 0x91, 0x9E, 0xFB, 0x25 };
+static const unsigned char transferDataProps = GATT_PROP_NOTIFY;
+static gattCharCfg_t transferProfileCharCfg[GATT_MAX_NUM_CONN];
+
+#define TRANSFER_DATA_ATTR        4
+#define TRANSFER_END_OFFSET       0xFFFF
+// How long to wait before retrying when the stack has no space for more notifications (ms)
+#define TRANSFER_RETRY_DELAY      10
+
+static struct
+{
+  unsigned short connHandle;
+  unsigned char name;         // File being sent, or 0 when idle
+  unsigned short record;      // Record holding the next data
+  unsigned short recordstart; // File offset of the start of that record
+  unsigned short offset;      // File offset of the next data
+  unsigned short resume;      // Offset we were asked to start from; the data before it is only added to the CRC
+  unsigned short crc;         // CRC of the file up to offset
+} transfer;
+
+static gattAttribute_t transferProfile[] =
+{
+  { { ATT_BT_UUID_SIZE, transfer_primary_service_uuid },  GATT_PERMIT_READ,                   0, (unsigned char*)&transferProfileService },
+  { { ATT_BT_UUID_SIZE, transfer_characteristic_uuid },   GATT_PERMIT_READ,                   0, (unsigned char*)&transferControlProps },
+  { { ATT_UUID_SIZE, transferControlUUID },               GATT_PERMIT_WRITE,                  0, NULL },
+  { { ATT_BT_UUID_SIZE, transfer_characteristic_uuid },   GATT_PERMIT_READ,                   0, (unsigned char*)&transferDataProps },
+  { { ATT_UUID_SIZE, transferDataUUID },                  0,                                  0, NULL },
+  { { ATT_BT_UUID_SIZE, transfer_client_config_uuid },    GATT_PERMIT_READ|GATT_PERMIT_WRITE, 0, (unsigned char*)transferProfileCharCfg },
+};
+
+static unsigned char transfer_write_callback(unsigned short handle, gattAttribute_t* attr, unsigned char* value, unsigned char len, unsigned short offset);
+
+static const gattServiceCBs_t transferProfileCB =
+{
+  NULL,
+  transfer_write_callback,
+  NULL
+};
+
+void transfer_init(void)
+{
+  GATTServApp_InitCharCfg(INVALID_CONNHANDLE, transferProfileCharCfg);
+  GATTServApp_RegisterService(transferProfile, GATT_NUM_ATTRS(transferProfile), &transferProfileCB);
+}
+
+//
+// The connection has gone, so forget its notification setting and anything we were sending it.
+//
+void transfer_disconnect(unsigned short handle)
+{
+  GATTServApp_InitCharCfg(handle, transferProfileCharCfg);
+  if (transfer.connHandle == handle)
+  {
+    transfer.name = 0;
+  }
+}
+
+static unsigned char transfer_write_callback(unsigned short handle, gattAttribute_t* attr, unsigned char* value, unsigned char len, unsigned short offset)
+{
+  if (attr->type.uuid == transfer_client_config_uuid)
+  {
+    // transfer_send() stops if this turns off notifications for the connection we're sending to
+    return GATTServApp_ProcessCCCWriteReq(handle, attr, value, len, offset, GATT_CLIENT_CFG_NOTIFY);
+  }
+  if (offset || (len != 1 && len != 3))
+  {
+    return ATT_ERR_INVALID_VALUE_SIZE;
+  }
+
+  transfer.name = 0;
+  if (value[0] >= 'A' && value[0] <= 'Z')
+  {
+    if (GATTServApp_ReadCharCfg(handle, transferProfileCharCfg) != GATT_CLIENT_CFG_NOTIFY)
+    {
+      return ATT_ERR_WRITE_NOT_PERMITTED;
+    }
+    transfer.connHandle = handle;
+    transfer.name = value[0];
+    transfer.record = 0;
+    transfer.recordstart = 0;
+    transfer.offset = 0;
+    transfer.resume = (len == 3 ? value[1] | (value[2] << 8) : 0);
+    transfer.crc = 0xFFFF;
+    OS_transfer_event(0);
+  }
+  return SUCCESS;
+}
+
+static unsigned short transfer_crc(unsigned short crc, unsigned char* data, unsigned char len)
+{
+  for (; len; len--)
+  {
+    crc ^= (unsigned short)*data++ << 8;
+    for (unsigned char b = 0; b < 8; b++)
+    {
+      crc = (crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1);
+    }
+  }
+  return crc;
+}
+
+//
+// Send as much of the current file as the stack will take. The data is copied straight
+// from the flash records into the notifications, and added to the CRC once it's been sent.
+//
+void transfer_send(void)
+{
+  attHandleValueNoti_t noti;
+  unsigned char* special;
+  unsigned char len;
+  unsigned char status;
+
+  noti.handle = transferProfile[TRANSFER_DATA_ATTR].handle;
+  while (transfer.name)
+  {
+    if (GATTServApp_ReadCharCfg(transfer.connHandle, transferProfileCharCfg) != GATT_CLIENT_CFG_NOTIFY)
+    {
+      // The client turned notifications off
+      transfer.name = 0;
+      return;
+    }
+    special = flashstore_findspecial(FS_MAKE_FILE_SPECIAL(transfer.name, transfer.record));
+    if (special)
+    {
+      len = special[FLASHSPECIAL_DATA_LEN] - FLASHSPECIAL_DATA_OFFSET;
+      if (transfer.offset >= transfer.recordstart + len)
+      {
+        transfer.recordstart += len;
+        transfer.record++;
+        continue;
+      }
+      special += FLASHSPECIAL_DATA_OFFSET + (transfer.offset - transfer.recordstart);
+      len -= transfer.offset - transfer.recordstart;
+      if (transfer.offset < transfer.resume)
+      {
+        // Resuming: the client already has this, but the CRC still needs it. We do a record
+        // at a time and let everything else run in between.
+        if (len > transfer.resume - transfer.offset)
+        {
+          len = transfer.resume - transfer.offset;
+        }
+        transfer.crc = transfer_crc(transfer.crc, special, len);
+        transfer.offset += len;
+        OS_transfer_event(0);
+        return;
+      }
+      if (len > sizeof(noti.value) - 2)
+      {
+        len = sizeof(noti.value) - 2;
+      }
+      noti.len = len + 2;
+      noti.value[0] = (unsigned char)transfer.offset;
+      noti.value[1] = (unsigned char)(transfer.offset >> 8);
+      OS_memcpy(&noti.value[2], special, len);
+    }
+    else
+    {
+      // End of file. Send the length and CRC of the whole file.
+      len = 0;
+      noti.len = 6;
+      noti.value[0] = (unsigned char)TRANSFER_END_OFFSET;
+      noti.value[1] = (unsigned char)(TRANSFER_END_OFFSET >> 8);
+      noti.value[2] = (unsigned char)transfer.offset;
+      noti.value[3] = (unsigned char)(transfer.offset >> 8);
+      noti.value[4] = (unsigned char)transfer.crc;
+      noti.value[5] = (unsigned char)(transfer.crc >> 8);
+    }
+
+    status = GATT_Notification(transfer.connHandle, &noti, FALSE);
+    if (status == MSG_BUFFER_NOT_AVAIL || status == bleMemAllocError)
+    {
+      // No room for more notifications yet, so try again shortly
+      OS_transfer_event(TRANSFER_RETRY_DELAY);
+      return;
+    }
+    if (status != SUCCESS || !len)
+    {
+      // Done, or the stack won't send to this connection (it's gone, or some other error)
+      transfer.name = 0;
+      return;
+    }
+    transfer.crc = transfer_crc(transfer.crc, special, len);
+    transfer.offset += len;
+  }
+}
+
+#endif // ENABLE_FILE_TRANSFER
@@ -1,4 +1,4 @@
-  RSEG XDATA_ROM_C:CONST:REORDER:NOROOT
-  PUBLIC NanoRiscImage
-NanoRiscImage EQU 0xB000
+  RSEG XDATA_ROM_C:CONST:REORDER:NOROOT
+  PUBLIC NanoRiscImage
+NanoRiscImage EQU 0xB000
   END
\ No newline at end of file
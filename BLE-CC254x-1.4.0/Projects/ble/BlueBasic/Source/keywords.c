@@ -36,6 +36,7 @@ struct keyword
   { "LEN", "FUNC_LEN" },
   { "RND", "FUNC_RND" },
   { "MILLIS", "FUNC_MILLIS" },
+  { "MICROS", "FUNC_MICROS" },
   { "BATTERY", "FUNC_BATTERY" },
   { "AUTORUN", "KW_AUTORUN" },
   { ">=", "OP_GE" },
@@ -69,15 +70,25 @@ struct keyword
   { "OUTPUT", "PM_OUTPUT" },
   { "RISING", "PM_RISING" },
   { "FALLING", "PM_FALLING" },
+  { "ONEWIRE", "PM_ONEWIRE" },
+  { "DHT", "PM_DHT" },
   { "P0", "KW_PIN_P0" },
   { "P1", "KW_PIN_P1" },
   { "P2", "KW_PIN_P2" },
   { "ANALOG", "KW_ANALOG" },
+  { "PWM", "KW_PWM" },
+  { "PROFILE", "KW_PROFILE" },
+  { "STATS", "KW_STATS" },
   { "CONFIG", "KW_CONFIG" },
   { "REFERENCE", "KW_CONSTANT,CO_REFERENCE" },
   { "RESOLUTION", "KW_CONSTANT,CO_RESOLUTION" },
   { "INTERNAL", "KW_CONSTANT,CO_INTERNAL" },
   { "EXTERNAL", "KW_CONSTANT,CO_EXTERNAL" },
+  { "CAPTURE", "KW_CONSTANT,CO_CAPTURE" },
+  { "DELIMITER", "KW_CONSTANT,CO_DELIMITER" },
+  { "RESET", "KW_CONSTANT,CO_RESET" },
+  { "SEARCH", "KW_CONSTANT,CO_SEARCH" },
+  { "REPORT", "KW_CONSTANT,CO_REPORT" },
   { "ONREAD", "BLE_ONREAD" },
   { "ONWRITE", "BLE_ONWRITE" },
   { "ONCONNECT", "BLE_ONCONNECT" },
@@ -118,6 +129,8 @@ struct keyword
   { "TRUNCATE", "FS_TRUNCATE" },
   { "APPEND", "FS_APPEND" },
   { "EOF", "FUNC_EOF" },
+  { "ADFIND", "FUNC_ADFIND" },
+  { "ADLEN", "FUNC_ADLEN" },
   //
   // Constants
   //
@@ -148,6 +161,19 @@ struct keyword
   { "BONDING_ENABLED", "KW_CONSTANT,CO_BONDING_ENABLED" },
 
   { "POWER", "KW_CONSTANT,CO_POWER" },
+
+  { "AD_FLAGS", "KW_CONSTANT,CO_AD_FLAGS" },
+  { "AD_UUID16", "KW_CONSTANT,CO_AD_UUID16" },
+  { "AD_UUID32", "KW_CONSTANT,CO_AD_UUID32" },
+  { "AD_UUID128", "KW_CONSTANT,CO_AD_UUID128" },
+  { "AD_NAME_SHORT", "KW_CONSTANT,CO_AD_NAME_SHORT" },
+  { "AD_NAME", "KW_CONSTANT,CO_AD_NAME" },
+  { "AD_TXPOWER", "KW_CONSTANT,CO_AD_TXPOWER" },
+  { "AD_SERVICE_DATA", "KW_CONSTANT,CO_AD_SERVICE_DATA" },
+  { "AD_MANUFACTURER", "KW_CONSTANT,CO_AD_MANUFACTURER" },
+
+  { "CONNECTION", "KW_CONSTANT,CO_CONNECTION" },
+  { "RSSI", "KW_CONSTANT,CO_RSSI" },
 };
 
 #define	NR_TABLES	13
@@ -1,387 +1,818 @@
-////////////////////////////////////////////////////////////////////////////////
-// BlueBasic
-////////////////////////////////////////////////////////////////////////////////
-//
-// Authors:
-//      Tim Wilkinson <timjwilkinson@gmail.com>
-//
-// os.c
-//
-
-#include "os.h"
-#include "OSAL.h"
-#include "OSAL_Clock.h"
-#include "hal_uart.h"
-#include "OSAL_PwrMgr.h"
-#ifdef FEATURE_OAD_HEADER
-#include "oad.h"
-#include "oad_target.h"
-#include "hal_flash.h"
-#endif
-#include "hal_uart.h"
-
-#define FILE_HANDLE_PROGRAM     0
-#define FILE_HANDLE_DATA        1
-#define FILE_HANDLE_MAX         (OS_MAX_FILE)
-
-#define	FILE_HEADER             (0x80)
-#define FILE_PROGRAM_FIRST      (0x81)
-#define FILE_PROGRAM_END        (FILE_PROGRAM_FIRST+0x20)
-#define FILE_DATA_FIRST         (FILE_PROGRAM_END+1)
-#define FILE_BLOCK_SIZE         (128)
-
-extern void osalTimeUpdate(void);
-
-extern uint8 blueBasic_TaskID;
-
-os_interrupt_t blueBasic_interrupts[OS_MAX_INTERRUPT];
-os_timer_t blueBasic_timers[OS_MAX_TIMER];
-os_discover_t blueBasic_discover;
-
-struct program_header
-{
-  char autorun;
-  unsigned short length[OS_MAX_FILE];
-};
-
-// Timers
-#define NR_TIMERS ((OS_MAX_TIMER) - 1)
-struct
-{
-  unsigned short lineno;
-} timers[OS_MAX_TIMER];
-
-// Serial
-os_serial_t serial[OS_MAX_SERIAL];
-
-enum {
-  MODE_STARTUP = 0,
-  MODE_NEED_INPUT,
-  MODE_GOT_INPUT,
-  MODE_RUNNING
-
-};
-static struct {
-  char* start;
-  char* end;
-  char* ptr;
-  char mode;
-  char quote;
-} input;
-
-#ifdef ENABLE_BLE_CONSOLE
-
-extern unsigned char ble_console_write(unsigned char ch);
-extern unsigned char ble_console_enabled;
-
-#endif
-
-#define CR	'\r'
-#define NL	'\n'
-#define BELL	'\b'
-#define SQUOTE  '\''
-#define DQUOTE  '\"'
-#define CTRLC	0x03
-#define CTRLH	0x08
-
-
-void OS_type(char c)
-{
-  switch (c)
-  {
-    case 0xff:
-      break;
-    case NL:
-    case CR:
-#ifdef ENABLE_CONSOLE_ECHO
-      OS_putchar('\n');
-#endif // ENABLE_CONSOLE_ECHO
-      *input.ptr = NL;
-      input.mode = MODE_GOT_INPUT;
-      // Wake the interpreter now we have something new to do
-      osal_set_event(blueBasic_TaskID, BLUEBASIC_INPUT_AVAILABLE);
-      break;
-    case CTRLH:
-      if(input.ptr == input.start)
-      {
-        break;
-      }
-      if (*--input.ptr == input.quote)
-      {
-        input.quote = 0;
-      }
-#ifdef ENABLE_CONSOLE_ECHO
-      OS_putchar(CTRLH);
-      OS_putchar(' ');
-      OS_putchar(CTRLH);
-#endif // ENABLE_CONSOLE_ECHO
-      break;
-    default:
-      if(input.ptr != input.end)
-      {
-        // Are we in a quoted string?
-        if(c == input.quote)
-        {
-          input.quote = 0;
-        }
-        else if (c == DQUOTE || c == SQUOTE)
-        {
-          input.quote = c;
-        }
-        else if (input.quote == 0 && c >= 'a' && c <= 'z')
-        {
-          c = c + 'A' - 'a';
-        }
-        *input.ptr++ = c;
-#ifdef ENABLE_CONSOLE_ECHO
-        OS_putchar(c);
-#endif
-      }
-      break;
-  }
-}
-
-void OS_prompt_buffer(unsigned char* start, unsigned char* end)
-{
-  input.mode = MODE_NEED_INPUT;
-  input.start = (char*)start;
-  input.end = (char*)end;
-  input.ptr = (char*)start;
-  input.quote = 0;
-}
-
-char OS_prompt_available(void)
-{
-  if (input.mode == MODE_GOT_INPUT)
-  {
-    input.mode = MODE_RUNNING;
-    return 1;
-  }
-  else
-  {
-    return 0;
-  }
-}
-
-void OS_putchar(char ch)
-{
-  ble_console_write(ch);
-}
-
-void* OS_rmemcpy(void *dst, const void GENERIC *src, unsigned int len)
-{
-  uint8 *pDst;
-  const uint8 GENERIC *pSrc;
-
-  pSrc = len + (uint8*)src;
-  pDst = len + (uint8*)dst;
-
-  while ( len-- )
-    *--pDst = *--pSrc;
-
-  return ( pDst );
-}
-
-void OS_init(void)
-{
-#ifndef ENABLE_BLE_CONSOLE
-  OS_openserial();
-#endif
-}
-
-void OS_timer_stop(unsigned char id)
-{
-  blueBasic_timers[id].linenum = 0;
-  osal_stop_timerEx(blueBasic_TaskID, BLUEBASIC_EVENT_TIMER << id);
-}
-
-char OS_timer_start(unsigned char id, unsigned long timeout, unsigned char repeat, unsigned short linenum)
-{
-  if (id >= OS_MAX_TIMER)
-  {
-    return 0;
-  }
-  blueBasic_timers[id].linenum = linenum;
-  if (repeat)
-  {
-    osal_start_reload_timer(blueBasic_TaskID, BLUEBASIC_EVENT_TIMER << id, timeout);
-  }
-  else
-  {
-    osal_start_timerEx(blueBasic_TaskID, BLUEBASIC_EVENT_TIMER << id, timeout);
-  }
-  return 1;
-}
-
-char OS_interrupt_attach(unsigned char pin, unsigned short lineno)
-{
-  unsigned char i;
-
-  for (i = 0; i < OS_MAX_INTERRUPT; i++)
-  {
-    if (blueBasic_interrupts[i].linenum == 0)
-    {
-      blueBasic_interrupts[i].pin = pin;
-      blueBasic_interrupts[i].linenum = lineno;
-      return 1;
-    }
-  }
-  return 0;
-}
-
-char OS_interrupt_detach(unsigned char pin)
-{
-  unsigned char i;
-
-  for (i = 0; i < OS_MAX_INTERRUPT; i++)
-  {
-    if (blueBasic_interrupts[i].pin == pin)
-    {
-      blueBasic_interrupts[i].pin = 0;
-      blueBasic_interrupts[i].linenum = 0;
-      return 1;
-    }
-  }
-  return 0;
-}
-
-long OS_get_millis(void)
-{
-  osalTimeUpdate();
-  return osal_getClock() * 1000 + osal_getMSClock();
-}
-
-void OS_set_millis(long timems)
-{
-  osal_setClock(timems / 1000);
-}
-
-void OS_reboot(char flash)
-{
- #ifdef FEATURE_OAD_HEADER
-  if (flash)
-  {
-    short zero = 0;
-    uint16 addr = OAD_IMG_B_PAGE * (HAL_FLASH_PAGE_SIZE / HAL_FLASH_WORD_SIZE);
-    HalFlashWrite(addr, (uint8*)&zero, sizeof(zero));
-  }
-#else
-  VOID flash;
-#endif
-  SystemReset();
-}
-
-#pragma optimize=none
-void OS_delaymicroseconds(short micros)
-{
-  // An empty loop is pretty accurate it turns out
-  while (micros-- > 0)
-    ;
-}
-
-void OS_flashstore_init(void)
-{
-  // If flashstore is uninitialized, deleting all the pages will set it up correctly.
-  if (*(unsigned long*)FLASHSTORE_CPU_BASEADDR == 0xFFFFFFFF)
-  {
-    flashstore_deleteall();
-  }
-}
-
-static void _uartCallback(uint8 port, uint8 event)
-{
-#ifdef HAL_UART_RX_WAKEUP
-  // UART woken up. This happens in the interrupt handler so we really
-  // don't want to do anything else.
-  if (event == HAL_UART_RX_WAKEUP)
-  {
-    return;
-  }
-#endif
-  if (port == HAL_UART_PORT_0 && (serial[0].onread || serial[0].onwrite))
-  {
-    osal_set_event(blueBasic_TaskID, BLUEBASIC_EVENT_SERIAL);
-  }
-}
-
-
-unsigned char OS_serial_open(unsigned char port, unsigned long baud, unsigned char parity, unsigned char bits, unsigned char stop, unsigned char flow, unsigned short onread, unsigned short onwrite)
-{
-  halUARTCfg_t config;
-  
-  switch (baud)
-  {
-    case 9600:
-      baud = HAL_UART_BR_9600;
-      break;
-    case 19200:
-      baud = HAL_UART_BR_19200;
-      break;
-    case 38400:
-      baud = HAL_UART_BR_38400;
-      break;
-    case 57600:
-      baud = HAL_UART_BR_57600;
-      break;
-    case 115200:
-      baud = HAL_UART_BR_115200;
-      break;
-    default:
-      return 2;
-  }
- 
-  // Only support port 0, no-parity, 8-bits, 1 stop bit
-  if (port != 0 || parity != 'N' || bits != 8 || stop != 1 || flow != 'H')
-  {
-    return 3;
-  }
-
-  config.configured = 1;
-  config.baudRate = baud;
-  config.flowControl = 1;
-  config.flowControlThreshold = 64;
-  config.idleTimeout = 0;
-  config.rx.maxBufSize = 128;
-  config.tx.maxBufSize = 128;
-  config.intEnable = 1;
-  config.callBackFunc = _uartCallback;
-  if (HalUARTOpen(HAL_UART_PORT_0, &config) == HAL_UART_SUCCESS)
-  {
-    serial[0].onread = onread;
-    serial[0].onwrite = onwrite;
-    return 0;
-  }
- 
-  return 1;
-}
-
-unsigned char OS_serial_close(unsigned char port)
-{
-  serial[0].onread = 0;
-  serial[0].onwrite = 0;
-  // HalUARTClose(0); - In the hal_uart.h include file, but not actually in the code
-  return 1;
-}
-
-short OS_serial_read(unsigned char port)
-{
-  unsigned char ch;
-  if (HalUARTRead(HAL_UART_PORT_0, &ch, 1) == 1)
-  {
-    return ch;
-  }
-  else
-  {
-    return -1;
-  }
-}
-
-unsigned char OS_serial_write(unsigned char port, unsigned char ch)
-{
-  return HalUARTWrite(HAL_UART_PORT_0, &ch, 1) == 1 ? 1 : 0;
-}
-
-unsigned char OS_serial_available(unsigned char port, unsigned char ch)
-{
-  return ch == 'R' ? Hal_UART_RxBufLen(HAL_UART_PORT_0) : Hal_UART_TxBufLen(HAL_UART_PORT_0);
-}
+////////////////////////////////////////////////////////////////////////////////
+// BlueBasic
+////////////////////////////////////////////////////////////////////////////////
+//
+// Authors:
+//      Tim Wilkinson <timjwilkinson@gmail.com>
+//
+// os.c
+//
+
+#include "os.h"
+#include "OSAL.h"
+#include "OSAL_Clock.h"
+#include "hal_uart.h"
+#include "OSAL_PwrMgr.h"
+#ifdef FEATURE_OAD_HEADER
+#include "oad.h"
+#include "oad_target.h"
+#include "hal_flash.h"
+#endif
+#include "hal_uart.h"
+
+#define FILE_HANDLE_PROGRAM     0
+#define FILE_HANDLE_DATA        1
+#define FILE_HANDLE_MAX         (OS_MAX_FILE)
+
+#define	FILE_HEADER             (0x80)
+#define FILE_PROGRAM_FIRST      (0x81)
+#define FILE_PROGRAM_END        (FILE_PROGRAM_FIRST+0x20)
+#define FILE_DATA_FIRST         (FILE_PROGRAM_END+1)
+#define FILE_BLOCK_SIZE         (128)
+
+extern void osalTimeUpdate(void);
+
+extern uint8 blueBasic_TaskID;
+
+static unsigned long _sleepTicks(void);
+static void _microsStart(void);
+static void _delayCalibrate(void);
+static void _interruptPurge(unsigned char id);
+
+os_interrupt_t blueBasic_interrupts[OS_MAX_INTERRUPT];
+os_counter_t blueBasic_counters[OS_MAX_COUNTER];
+os_timer_t blueBasic_timers[OS_MAX_TIMER];
+os_discover_t blueBasic_discover;
+
+struct program_header
+{
+  char autorun;
+  unsigned short length[OS_MAX_FILE];
+};
+
+// Timers
+#define NR_TIMERS ((OS_MAX_TIMER) - 1)
+struct
+{
+  unsigned short lineno;
+} timers[OS_MAX_TIMER];
+
+// Serial
+os_serial_t serial[OS_MAX_SERIAL];
+
+enum {
+  MODE_STARTUP = 0,
+  MODE_NEED_INPUT,
+  MODE_GOT_INPUT,
+  MODE_RUNNING
+
+};
+static struct {
+  char* start;
+  char* end;
+  char* ptr;
+  char mode;
+  char quote;
+} input;
+
+#ifdef ENABLE_BLE_CONSOLE
+
+extern unsigned char ble_console_write(unsigned char ch);
+extern unsigned char ble_console_enabled;
+
+#endif
+
+#define CR	'\r'
+#define NL	'\n'
+#define BELL	'\b'
+#define SQUOTE  '\''
+#define DQUOTE  '\"'
+#define CTRLC	0x03
+#define CTRLH	0x08
+
+
+void OS_type(char c)
+{
+  switch (c)
+  {
+    case 0xff:
+      break;
+    case NL:
+    case CR:
+#ifdef ENABLE_CONSOLE_ECHO
+      OS_putchar('\n');
+#endif // ENABLE_CONSOLE_ECHO
+      *input.ptr = NL;
+      input.mode = MODE_GOT_INPUT;
+      // Wake the interpreter now we have something new to do
+      osal_set_event(blueBasic_TaskID, BLUEBASIC_INPUT_AVAILABLE);
+      break;
+    case CTRLH:
+      if(input.ptr == input.start)
+      {
+        break;
+      }
+      if (*--input.ptr == input.quote)
+      {
+        input.quote = 0;
+      }
+#ifdef ENABLE_CONSOLE_ECHO
+      OS_putchar(CTRLH);
+      OS_putchar(' ');
+      OS_putchar(CTRLH);
+#endif // ENABLE_CONSOLE_ECHO
+      break;
+    default:
+      if(input.ptr != input.end)
+      {
+        // Are we in a quoted string?
+        if(c == input.quote)
+        {
+          input.quote = 0;
+        }
+        else if (c == DQUOTE || c == SQUOTE)
+        {
+          input.quote = c;
+        }
+        else if (input.quote == 0 && c >= 'a' && c <= 'z')
+        {
+          c = c + 'A' - 'a';
+        }
+        *input.ptr++ = c;
+#ifdef ENABLE_CONSOLE_ECHO
+        OS_putchar(c);
+#endif
+      }
+      break;
+  }
+}
+
+void OS_prompt_buffer(unsigned char* start, unsigned char* end)
+{
+  input.mode = MODE_NEED_INPUT;
+  input.start = (char*)start;
+  input.end = (char*)end;
+  input.ptr = (char*)start;
+  input.quote = 0;
+}
+
+char OS_prompt_available(void)
+{
+  if (input.mode == MODE_GOT_INPUT)
+  {
+    input.mode = MODE_RUNNING;
+    return 1;
+  }
+  else
+  {
+    return 0;
+  }
+}
+
+void OS_putchar(char ch)
+{
+  ble_console_write(ch);
+}
+
+void* OS_rmemcpy(void *dst, const void GENERIC *src, unsigned int len)
+{
+  uint8 *pDst;
+  const uint8 GENERIC *pSrc;
+
+  pSrc = len + (uint8*)src;
+  pDst = len + (uint8*)dst;
+
+  while ( len-- )
+    *--pDst = *--pSrc;
+
+  return ( pDst );
+}
+
+void OS_init(void)
+{
+#ifndef ENABLE_BLE_CONSOLE
+  OS_openserial();
+#endif
+#if OS_MAX_SERIAL > 1
+  // The HAL claims USART1's Rx/Tx pins (P1.6/P1.7) at boot; leave them as GPIO until SERIAL #1 is opened
+  P1SEL &= ~0xC0;
+#endif
+  _microsStart();
+  _delayCalibrate();
+}
+
+void OS_timer_stop(unsigned char id)
+{
+  blueBasic_timers[id].linenum = 0;
+  osal_stop_timerEx(blueBasic_TaskID, BLUEBASIC_EVENT_TIMER << id);
+}
+
+char OS_timer_start(unsigned char id, unsigned long timeout, unsigned char repeat, unsigned short linenum)
+{
+  if (id >= OS_MAX_TIMER)
+  {
+    return 0;
+  }
+  blueBasic_timers[id].linenum = linenum;
+  if (repeat)
+  {
+    osal_start_reload_timer(blueBasic_TaskID, BLUEBASIC_EVENT_TIMER << id, timeout);
+  }
+  else
+  {
+    osal_start_timerEx(blueBasic_TaskID, BLUEBASIC_EVENT_TIMER << id, timeout);
+  }
+  return 1;
+}
+
+char OS_interrupt_attach(unsigned char pin, unsigned short lineno)
+{
+  unsigned char i;
+
+  for (i = 0; i < OS_MAX_INTERRUPT; i++)
+  {
+    if (blueBasic_interrupts[i].linenum == 0)
+    {
+      blueBasic_interrupts[i].pin = pin;
+      blueBasic_interrupts[i].linenum = lineno;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+char OS_interrupt_detach(unsigned char pin)
+{
+  unsigned char i;
+
+  for (i = 0; i < OS_MAX_INTERRUPT; i++)
+  {
+    if (blueBasic_interrupts[i].pin == pin)
+    {
+      blueBasic_interrupts[i].pin = 0;
+      blueBasic_interrupts[i].linenum = 0;
+      _interruptPurge(i);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+//
+// Pin change event queue. The port ISRs add at the tail and the task removes from the head;
+// each side only writes its own (single byte) index so neither has to lock the other out.
+// Events are stamped with the 32kHz sleep timer, which keeps running while we sleep and is
+// cheap to read in an ISR, and turned into MILLIS time when BASIC reads them.
+//
+static struct
+{
+  unsigned char id;
+  unsigned long ticks;
+} pinEvents[OS_MAX_PINEVENT];
+static volatile unsigned char pinEventHead;
+static volatile unsigned char pinEventTail;
+static unsigned char pinEventRead;
+static unsigned char pinEventId = OS_PINEVENT_TAKEN;
+
+#define PINEVENT_NEXT(I)  (((I) + 1) & (OS_MAX_PINEVENT - 1))
+
+static unsigned long _sleepTicks(void)
+{
+  // Reading ST0 latches ST1 and ST2
+  unsigned long ticks = ST0;
+  ticks |= (unsigned long)ST1 << 8;
+  ticks |= (unsigned long)ST2 << 16;
+  return ticks;
+}
+
+void OS_interrupt_queue(unsigned char id)
+{
+  const unsigned char tail = pinEventTail;
+  const unsigned char next = PINEVENT_NEXT(tail);
+
+  // When full we drop the newest event; the handler will still run for the ones we kept
+  if (next != pinEventHead)
+  {
+    pinEvents[tail].id = id;
+    pinEvents[tail].ticks = _sleepTicks();
+    pinEventTail = next;
+  }
+  osal_set_event(blueBasic_TaskID, BLUEBASIC_EVENT_INTERRUPT);
+}
+
+//
+// Run the handler once for each queued event, oldest first. Events a handler has already
+// taken with INTERRUPT READ are skipped. We only do the events which were queued when we
+// started, so a fast pin can't keep us here and starve the rest of OSAL; if more have
+// arrived we go round again as a new event.
+//
+void OS_interrupt_dispatch(void)
+{
+  const unsigned char tail = pinEventTail;
+
+  while (pinEventHead != tail)
+  {
+    const unsigned char id = pinEvents[pinEventHead].id;
+    if (id != OS_PINEVENT_TAKEN && blueBasic_interrupts[id].linenum)
+    {
+      pinEventId = id;
+      pinEventRead = pinEventHead;
+      STATS_COUNT(STATS_EVENT_PIN);
+      interpreter_run(blueBasic_interrupts[id].linenum, 1);
+      pinEventId = OS_PINEVENT_TAKEN;
+    }
+    pinEventHead = PINEVENT_NEXT(pinEventHead);
+  }
+  if (pinEventHead != pinEventTail)
+  {
+    osal_set_event(blueBasic_TaskID, BLUEBASIC_EVENT_INTERRUPT);
+  }
+}
+
+//
+// Forget the queued events for an interrupt which has been detached, so whatever attaches
+// there next doesn't see them. The ISRs only add at the tail, so marking the ones already
+// queued is safe without a lock.
+//
+static void _interruptPurge(unsigned char id)
+{
+  const unsigned char tail = pinEventTail;
+  unsigned char i;
+
+  for (i = pinEventHead; i != tail; i = PINEVENT_NEXT(i))
+  {
+    if (pinEvents[i].id == id)
+    {
+      pinEvents[i].id = OS_PINEVENT_TAKEN;
+    }
+  }
+}
+
+//
+// Take the next queued event for the pin whose handler is running, returning when it
+// happened in MILLIS time. Returns 0 when there are no more.
+//
+unsigned char OS_interrupt_read(long* time)
+{
+  if (pinEventId == OS_PINEVENT_TAKEN)
+  {
+    return 0;
+  }
+  for (; pinEventRead != pinEventTail; pinEventRead = PINEVENT_NEXT(pinEventRead))
+  {
+    if (pinEvents[pinEventRead].id == pinEventId)
+    {
+      const unsigned long age = (_sleepTicks() - pinEvents[pinEventRead].ticks) & 0xFFFFFF;
+      *time = OS_get_millis() - (long)((age * 125) >> 12); // 32768 ticks per second
+      pinEvents[pinEventRead].id = OS_PINEVENT_TAKEN;
+      pinEventRead = PINEVENT_NEXT(pinEventRead);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+long OS_get_millis(void)
+{
+  osalTimeUpdate();
+  return osal_getClock() * 1000 + osal_getMSClock();
+}
+
+void OS_set_millis(long timems)
+{
+  osal_setClock(timems / 1000);
+}
+
+void OS_reboot(char flash)
+{
+ #ifdef FEATURE_OAD_HEADER
+  if (flash)
+  {
+    short zero = 0;
+    uint16 addr = OAD_IMG_B_PAGE * (HAL_FLASH_PAGE_SIZE / HAL_FLASH_WORD_SIZE);
+    HalFlashWrite(addr, (uint8*)&zero, sizeof(zero));
+  }
+#else
+  VOID flash;
+#endif
+  SystemReset();
+}
+
+//
+// Microsecond clock. Timer 4 free-runs at 250kHz (4us a tick) and its overflow interrupt adds
+// 1024us to blueBasic_micros. The timer stops while we sleep in PM2, so each read compares it
+// with the sleep timer, which never stops, and adds on any time we missed.
+//
+#define MICROS_T4CTL        0xFC  // Tick/128, start, overflow interrupt, clear, free running
+#define MICROS_T4OVFIF      0x08
+#define MICROS_SLEEP_SLACK  100   // Two sleep timer ticks plus reading time
+
+volatile unsigned long blueBasic_micros;
+
+static struct
+{
+  unsigned long offset;
+  unsigned long micros;
+  unsigned long ticks;
+  long millis;
+} microsSync;
+
+static void _microsStart(void)
+{
+  T4CTL = MICROS_T4CTL;
+  IEN1 |= 1 << 4;
+  microsSync.ticks = _sleepTicks();
+  microsSync.millis = OS_get_millis();
+}
+
+unsigned long OS_get_micros(void)
+{
+  unsigned char istate;
+  unsigned char low;
+  unsigned long now;
+
+  OS_critical_enter(istate);
+  low = T4CNT;
+  now = blueBasic_micros;
+  if ((TIMIF & MICROS_T4OVFIF) && low < 128)
+  {
+    // Overflowed since we disabled interrupts
+    now += 1024;
+  }
+  OS_critical_exit(istate);
+  now += ((unsigned short)low << 2) + microsSync.offset;
+
+  // Catch up with any time spent asleep. Beyond one sleep timer wrap (512s) we have to rely
+  // on the millisecond clock instead.
+  const unsigned long ticks = _sleepTicks();
+  const long millis = OS_get_millis();
+  const unsigned long delta = (ticks - microsSync.ticks) & 0xFFFFFF;
+  unsigned long slept = (delta >> 9) * 15625 + (((delta & 511) * 15625) >> 9);
+  if (millis - microsSync.millis > 500000L)
+  {
+    slept = (unsigned long)(millis - microsSync.millis) * 1000;
+  }
+  if (slept > now - microsSync.micros + MICROS_SLEEP_SLACK)
+  {
+    microsSync.offset += slept - (now - microsSync.micros);
+    now = microsSync.micros + slept;
+  }
+  microsSync.micros = now;
+  microsSync.ticks = ticks;
+  microsSync.millis = millis;
+  return now;
+}
+
+//
+// Busy wait. Short waits spin a loop calibrated against Timer 4 at boot; longer ones watch
+// Timer 4 itself so an interrupt part way through doesn't add to the total.
+//
+#define DELAY_SPIN_USEC       16
+#define DELAY_CALIBRATE_LOOPS 4096
+
+static unsigned short delayScale = 256; // Loops per microsecond (8.8 fixed point)
+
+#pragma optimize=none
+static void _delayLoop(unsigned short loops)
+{
+  while (loops--)
+    ;
+}
+
+static void _delayCalibrate(void)
+{
+  const unsigned long start = OS_get_micros();
+  _delayLoop(DELAY_CALIBRATE_LOOPS);
+  const unsigned long elapsed = OS_get_micros() - start;
+  if (elapsed)
+  {
+    delayScale = ((unsigned long)DELAY_CALIBRATE_LOOPS << 8) / elapsed;
+  }
+}
+
+void OS_delaymicroseconds(short micros)
+{
+  if (micros <= 0)
+  {
+    return;
+  }
+  if (micros < DELAY_SPIN_USEC)
+  {
+    _delayLoop(((unsigned long)micros * delayScale) >> 8);
+    return;
+  }
+  short ticks = (micros + 2) >> 2;
+  unsigned char last = T4CNT;
+  while (ticks > 0)
+  {
+    const unsigned char now = T4CNT;
+    ticks -= (unsigned char)(now - last);
+    last = now;
+  }
+}
+
+void OS_flashstore_init(void)
+{
+  // If flashstore is uninitialized, deleting all the pages will set it up correctly.
+  if (*(unsigned long*)FLASHSTORE_CPU_BASEADDR == 0xFFFFFFFF)
+  {
+    flashstore_deleteall();
+  }
+}
+
+//
+// Move whatever the HAL has received into the software ring, counting delimiters
+// as they arrive so framing doesn't need to rescan the buffer.
+//
+static void _serialFill(unsigned char port)
+{
+  os_serial_t* s = &serial[port];
+  unsigned char received = 0;
+
+  while (s->rxlen < s->rxsize)
+  {
+    unsigned short pos = s->rxhead + s->rxlen;
+    if (pos >= s->rxsize)
+    {
+      pos -= s->rxsize;
+    }
+    unsigned short len = (pos >= s->rxhead ? s->rxsize - pos : s->rxhead - pos);
+    len = HalUARTRead(port, s->rxbuf + pos, len);
+    if (!len)
+    {
+      break;
+    }
+    received = 1;
+    s->rxlen += len;
+    if (s->delimiter != OS_SERIAL_NODELIMITER)
+    {
+      for (unsigned char* ptr = s->rxbuf + pos; len; len--)
+      {
+        if (*ptr++ == (unsigned char)s->delimiter)
+        {
+          s->frames++;
+        }
+      }
+    }
+  }
+  if (received && s->idle)
+  {
+    // Restart the idle timer with each burst of data
+    osal_start_timerEx(blueBasic_TaskID, OS_SERIAL_EVENT(port), s->idle);
+  }
+}
+
+static void _uartCallback(uint8 port, uint8 event)
+{
+#ifdef HAL_UART_RX_WAKEUP
+  // UART woken up. This happens in the interrupt handler so we really
+  // don't want to do anything else.
+  if (event == HAL_UART_RX_WAKEUP)
+  {
+    return;
+  }
+#endif
+  if (port < OS_MAX_SERIAL && serial[port].rxbuf)
+  {
+    if (event & (HAL_UART_RX_FULL | HAL_UART_RX_ABOUT_FULL | HAL_UART_RX_TIMEOUT))
+    {
+      _serialFill(port);
+    }
+    if ((serial[port].onread && OS_serial_ready(port)) || serial[port].onwrite)
+    {
+      osal_set_event(blueBasic_TaskID, OS_SERIAL_EVENT(port));
+    }
+  }
+}
+
+//
+// Find the UxBAUD (mantissa) and UxGCR (exponent) values for any baud rate, where
+//  baud = (256 + M) * 2^E * 32MHz / 2^28, so (256 + M) * 2^E = baud * 2^17 / 15625
+//
+static unsigned char _serialBaud(unsigned long baud, unsigned char* m)
+{
+  if (baud < OS_SERIAL_MIN_BAUD || baud > OS_SERIAL_MAX_BAUD)
+  {
+    return 0xFF;
+  }
+  for (unsigned char e = 16; ; e--)
+  {
+    unsigned long v = ((baud << (17 - e)) + 15625 / 2) / 15625;
+    if (v >= 256 || !e)
+    {
+      *m = v - 256;
+      return e;
+    }
+  }
+}
+
+unsigned char OS_serial_open(unsigned char port, unsigned long baud, unsigned char parity, unsigned char bits, unsigned char stop, unsigned char flow, unsigned short rxsize, unsigned short onread, unsigned short onwrite)
+{
+  halUARTCfg_t config;
+  unsigned char m;
+  unsigned char e = _serialBaud(baud, &m);
+  unsigned char ucr = 0;
+
+  if (e == 0xFF)
+  {
+    return 2;
+  }
+ 
+  // 8 data bits with optional even or odd parity (sent as a 9th bit), 1 or 2 stop bits
+  if (port >= OS_MAX_SERIAL || bits != 8 || (stop != 1 && stop != 2) || (flow != 'H' && flow != 'N'))
+  {
+    return 3;
+  }
+  switch (parity)
+  {
+    case 'N':
+      break;
+    // UxUCR.D9 picks the parity when UxUCR.PARITY is set: 1 is even, 0 is odd (CC253x/4x User's Guide, SWRU191, UxUCR)
+    case 'E':
+      ucr = UCR_D9 | UCR_BIT9 | UCR_PARITY;
+      break;
+    case 'O':
+      ucr = UCR_BIT9 | UCR_PARITY;
+      break;
+    default:
+      return 3;
+  }
+  if (stop == 2)
+  {
+    ucr |= UCR_SPB;
+  }
+
+  OS_serial_close(port);
+  if (!rxsize)
+  {
+    rxsize = OS_SERIAL_RXBUF;
+  }
+  serial[port].rxbuf = OS_malloc(rxsize);
+  if (!serial[port].rxbuf)
+  {
+    return 4;
+  }
+  serial[port].rxsize = rxsize;
+
+  // The HAL only knows a handful of rates, so open with one and then set the real divisor
+  config.configured = 1;
+  config.baudRate = HAL_UART_BR_115200;
+  config.flowControl = (flow == 'H');
+  config.flowControlThreshold = 64;
+  config.idleTimeout = 0;
+  config.rx.maxBufSize = 128;
+  config.tx.maxBufSize = 128;
+  config.intEnable = 1;
+  config.callBackFunc = _uartCallback;
+  if (HalUARTOpen(port, &config) == HAL_UART_SUCCESS)
+  {
+    if (port == 0)
+    {
+      U0BAUD = m;
+      U0GCR = e;
+      U0UCR |= ucr;
+    }
+    else
+    {
+      P1SEL |= 0xC0;
+      U1BAUD = m;
+      U1GCR = e;
+      U1UCR |= ucr;
+    }
+    serial[port].onread = onread;
+    serial[port].onwrite = onwrite;
+    return 0;
+  }
+ 
+  OS_serial_close(port);
+  return 1;
+}
+
+void OS_serial_framing(unsigned char port, short delimiter, unsigned short count, unsigned short idle)
+{
+  serial[port].delimiter = delimiter;
+  serial[port].count = count;
+  serial[port].idle = idle;
+  serial[port].frames = 0;
+}
+
+unsigned char OS_serial_close(unsigned char port)
+{
+  osal_stop_timerEx(blueBasic_TaskID, OS_SERIAL_EVENT(port));
+  if (serial[port].rxbuf)
+  {
+    OS_free(serial[port].rxbuf);
+  }
+  OS_memset(&serial[port], 0, sizeof(os_serial_t));
+  serial[port].delimiter = OS_SERIAL_NODELIMITER;
+  // HalUARTClose(port); - In the hal_uart.h include file, but not actually in the code
+  return 1;
+}
+
+unsigned short OS_serial_read_block(unsigned char port, unsigned char* buf, unsigned short len)
+{
+  os_serial_t* s = &serial[port];
+  unsigned short total = 0;
+
+  if (!s->rxbuf)
+  {
+    return 0;
+  }
+  _serialFill(port);
+  while (len && s->rxlen)
+  {
+    unsigned short chunk = s->rxsize - s->rxhead;
+    if (chunk > s->rxlen)
+    {
+      chunk = s->rxlen;
+    }
+    if (chunk > len)
+    {
+      chunk = len;
+    }
+    if (s->frames)
+    {
+      unsigned char* ptr = s->rxbuf + s->rxhead;
+      for (unsigned short i = chunk; i && s->frames; i--)
+      {
+        if (*ptr++ == (unsigned char)s->delimiter)
+        {
+          s->frames--;
+        }
+      }
+    }
+    OS_memcpy(buf, s->rxbuf + s->rxhead, chunk);
+    buf += chunk;
+    len -= chunk;
+    total += chunk;
+    s->rxlen -= chunk;
+    s->rxhead += chunk;
+    if (s->rxhead == s->rxsize)
+    {
+      s->rxhead = 0;
+    }
+  }
+  // Make room for anything the HAL is still holding, then re-fire ONREAD if a further frame is waiting
+  _serialFill(port);
+  if (total && s->onread && OS_serial_ready(port))
+  {
+    osal_set_event(blueBasic_TaskID, OS_SERIAL_EVENT(port));
+  }
+  return total;
+}
+
+unsigned short OS_serial_write_block(unsigned char port, unsigned char* buf, unsigned short len)
+{
+  return HalUARTWrite(port, buf, len);
+}
+
+short OS_serial_read(unsigned char port)
+{
+  unsigned char ch;
+  if (OS_serial_read_block(port, &ch, 1) == 1)
+  {
+    return ch;
+  }
+  else
+  {
+    return -1;
+  }
+}
+
+unsigned char OS_serial_write(unsigned char port, unsigned char ch)
+{
+  return OS_serial_write_block(port, &ch, 1) == 1 ? 1 : 0;
+}
+
+unsigned short OS_serial_available(unsigned char port, unsigned char ch)
+{
+  if (ch == 'R')
+  {
+    _serialFill(port);
+    return serial[port].rxlen + Hal_UART_RxBufLen(port);
+  }
+  return Hal_UART_TxBufLen(port);
+}
+
+//
+// Is a frame ready for ONREAD? Without any framing, any data will do. A full buffer
+// always counts so a missing delimiter can't stall the port.
+//
+unsigned char OS_serial_ready(unsigned char port)
+{
+  os_serial_t* s = &serial[port];
+
+  if (!s->rxlen)
+  {
+    return 0;
+  }
+  if (s->frames || s->rxlen == s->rxsize || (s->count && s->rxlen >= s->count))
+  {
+    return 1;
+  }
+  if (s->idle)
+  {
+    return osal_get_timeoutEx(blueBasic_TaskID, OS_SERIAL_EVENT(port)) ? 0 : 1;
+  }
+  return s->delimiter == OS_SERIAL_NODELIMITER && !s->count;
+}
@@ -0,0 +1,43 @@
+#!/bin/bash
+
+#  benchrunner.sh
+#  BlueBasic
+#
+#  Usage: benchrunner.sh [benchmark ...]
+#  Runs the named benchmarks, or every benchmark listed in 'benchmarks', through the
+#  simulator and prints one JSON object per benchmark for regression tracking.
+#  Set BLUEBASIC to pick the interpreter binary (the CMake 'bench' target does this).
+#
+#  Each .bbasic file is typed into a fresh simulator exactly as written (with the flash kept
+#  in memory), with the events in a matching .events file (if there is one) injected on the
+#  simulator's virtual clock.
+#  Statement, expression and event counts, flash activity and memory peaks come from the
+#  simulator's BLUEBASIC_STATS report; rates are per second of CPU time.
+
+BLUEBASIC=${BLUEBASIC:-$(echo $HOME/Library/Developer/Xcode/DerivedData/BlueBasic-*/Build/Products/Debug/BlueBasic)}
+
+for bench in ${@:-$(cat benchmarks)}
+do
+  events=""
+  if [ -f $bench.events ]
+  then
+    events=$bench.events
+  fi
+  stats=$(BLUEBASIC_STATS=1 BLUEBASIC_EVENTS=$events BLUEBASIC_FLASHSTORE= $BLUEBASIC < $bench.bbasic 2>&1 >/dev/null | grep '^STATS:')
+  if [ -z "$stats" ]
+  then
+    echo "** $bench: FAILURE" >&2
+    exit 1
+  fi
+  echo "$stats" | awk -v name=$bench '{
+    for (i = 2; i <= NF; i++)
+    {
+      split($i, kv, "=")
+      v[kv[1]] = kv[2]
+    }
+    s = v["cpu_ms"] > 0 ? 1000 / v["cpu_ms"] : 0
+    printf "{\"name\":\"%s\",\"cpu_ms\":%s,\"virtual_ms\":%s,\"statements\":%s,\"expressions\":%s,\"events\":%s,", name, v["cpu_ms"], v["virtual_ms"], v["statements"], v["expressions"], v["events"]
+    printf "\"statements_per_sec\":%d,\"expressions_per_sec\":%d,\"events_per_sec\":%d,", v["statements"] * s, v["expressions"] * s, v["events"] * s
+    printf "\"flash_writes\":%s,\"flash_erases\":%s,\"heap_peak\":%s,\"stack_peak\":%s}\n", v["flash_writes"], v["flash_erases"], v["heap_peak"], v["stack_peak"]
+  }'
+done
@@ -7,16 +7,209 @@
 //
 
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include "os.h"
 
 extern void interpreter_setup(void);
 extern void interpreter_loop(void);
 
+static const char* const usage =
+  "usage: bluebasic [-l program.bbasic] [-r] [-t seconds] [-s statements] [-j state.json]\n"
+  "  -l  load the numbered lines of a program into flash (anything else in it is ignored)\n"
+  "  -r  RUN the program\n"
+  "  -t  stop at this virtual time\n"
+  "  -s  stop after this many statements\n"
+  "  -j  write variables, arrays, flash pages and counters to this file as JSON ('-' for stdout)\n"
+  "With -l or -r the console input is just those commands, and isn't echoed. Otherwise it's read\n"
+  "from stdin as usual.\n";
+
+// Names for blueBasic_stats, in order
+static const char* const stats_names[STATS_MAX] =
+{
+  "findline", "findspecial", "compact", "flash_writes", "flash_erases", "expressions", "oom",
+  "timer_events", "pin_events", "serial_events", "connect_events", "read_events", "write_events",
+  "scan_events", "capture_events"
+};
+
+static void dump_flash(FILE* fp)
+{
+  const unsigned char* page;
+
+  fprintf(fp, "\"flash\":{\"free\":%u,\"waste\":%u,\"pages\":[", flashstore_freemem(), flashstore_wastemem());
+  for (page = __store; page < &__store[FLASHSTORE_LEN]; page += FLASHSTORE_PAGESIZE)
+  {
+    unsigned short lines = 0;
+    unsigned short specials = 0;
+    unsigned short invalid = 0;
+    const unsigned char* ptr;
+
+    // Same layout as BlueBasic_Flashstore.c: <age:4> then <id:2><len:1><data> items, padded to 4 bytes
+    for (ptr = page + sizeof(unsigned int); ptr < page + FLASHSTORE_PAGESIZE; )
+    {
+      const unsigned short id = *(unsigned short*)ptr;
+      const unsigned short size = ptr[sizeof(unsigned short)] ? (ptr[sizeof(unsigned short)] + 3) & -4 : 4;
+      if (id == FLASHID_FREE || ptr + size > page + FLASHSTORE_PAGESIZE)
+      {
+        break;
+      }
+      if (id == FLASHID_INVALID)
+      {
+        invalid++;
+      }
+      else if (id == FLASHID_SPECIAL)
+      {
+        specials++;
+      }
+      else
+      {
+        lines++;
+      }
+      ptr += size;
+    }
+    fprintf(fp, "%s{\"age\":%u,\"lines\":%u,\"specials\":%u,\"invalid\":%u,\"free\":%u}", page == __store ? "" : ",",
+            *(unsigned int*)page, lines, specials, invalid, (unsigned)(page + FLASHSTORE_PAGESIZE - ptr));
+  }
+  fprintf(fp, "]}");
+}
+
+static void dump_state(const char* name)
+{
+  FILE* fp = (strcmp(name, "-") ? fopen(name, "w") : stdout);
+  unsigned char i;
+  char var;
+  char first;
+
+  if (!fp)
+  {
+    perror(name);
+    exit(1);
+  }
+  fprintf(fp, "{\"virtual_ms\":%lu,\"counters\":{\"statements\":%lu,\"events\":%lu,\"heap_peak\":%u,\"stack_peak\":%u",
+          OS_get_micros() / 1000, sim_stats.statements, sim_stats.events, sim_stats.heap_peak, sim_stats.stack_peak);
+  for (i = 0; i < STATS_MAX; i++)
+  {
+    fprintf(fp, ",\"%s\":%lu", stats_names[i], blueBasic_stats[i]);
+  }
+  fprintf(fp, "},\"variables\":{");
+  for (first = 1, var = 'A'; var <= 'Z'; var++)
+  {
+    unsigned char* array;
+    unsigned short len;
+    long value = interpreter_variable(var, &array, &len);
+    if (!len)
+    {
+      fprintf(fp, "%s\"%c\":%ld", first ? "" : ",", var, value);
+      first = 0;
+    }
+  }
+  fprintf(fp, "},\"arrays\":{");
+  for (first = 1, var = 'A'; var <= 'Z'; var++)
+  {
+    unsigned char* array;
+    unsigned short len;
+    unsigned short j;
+    interpreter_variable(var, &array, &len);
+    if (len)
+    {
+      fprintf(fp, "%s\"%c\":[", first ? "" : ",", var);
+      for (j = 0; j < len; j++)
+      {
+        fprintf(fp, "%s%u", j ? "," : "", array[j]);
+      }
+      fprintf(fp, "]");
+      first = 0;
+    }
+  }
+  fprintf(fp, "},");
+  dump_flash(fp);
+  fprintf(fp, "}\n");
+  if (fp != stdout)
+  {
+    fclose(fp);
+  }
+}
+
 int main(int argc, const char * argv[])
 {
+  const char* flash = getenv("BLUEBASIC_FLASHSTORE");
+  const char* program = NULL;
+  const char* json = NULL;
+  char run = 0;
+  int opt;
+
+  while ((opt = getopt(argc, (char* const*)argv, "l:rt:s:j:h")) != -1)
+  {
+    switch (opt)
+    {
+      case 'l':
+        program = optarg;
+        break;
+      case 'r':
+        run = 1;
+        break;
+      case 't':
+        sim_max_millis = (unsigned long)(strtod(optarg, NULL) * 1000);
+        break;
+      case 's':
+        sim_max_statements = strtoul(optarg, NULL, 10);
+        break;
+      case 'j':
+        json = optarg;
+        break;
+      default:
+        fputs(usage, stderr);
+        return 2;
+    }
+  }
+
+  // Each test keeps its own flash image (an empty name keeps it in memory). A loaded program
+  // stays in memory unless one is named.
+  if (flash)
+  {
+    sim_flashstore = (*flash ? flash : NULL);
+  }
+  else if (program)
+  {
+    sim_flashstore = NULL;
+  }
+  if (!sim_flashstore)
+  {
+    sim_flashstore_format();
+  }
+  sim_services();
   interpreter_setup();
-  interpreter_loop();
-  
+  if (program || run)
+  {
+    unsigned long len;
+    unsigned char* input = sim_program_input(program, run, &len);
+    sim_echo = 0;
+    sim_input(input, len);
+    interpreter_loop();
+    free(input);
+  }
+  else
+  {
+    interpreter_loop();
+  }
+
+  if (json)
+  {
+    dump_state(json);
+  }
+  if (getenv("BLUEBASIC_WIRE_TIMING"))
+  {
+    fprintf(stderr, "WIRE: %lu compiles %.3fms, %lu cached, %.3fms executing\n",
+            wire_timing.compiles, wire_timing.compile * 1000.0 / CLOCKS_PER_SEC,
+            wire_timing.hits, wire_timing.exec * 1000.0 / CLOCKS_PER_SEC);
+  }
+  if (getenv("BLUEBASIC_STATS"))
+  {
+    // One line of name=value pairs for Benchmarks/benchrunner.sh
+    fprintf(stderr, "STATS: cpu_ms=%.3f virtual_ms=%lu statements=%lu expressions=%lu events=%lu flash_writes=%lu flash_erases=%lu heap_peak=%u stack_peak=%u\n",
+            clock() * 1000.0 / CLOCKS_PER_SEC, OS_get_micros() / 1000, sim_stats.statements, blueBasic_stats[STATS_EXPRESSION], sim_stats.events,
+            blueBasic_stats[STATS_FLASH_WRITE], blueBasic_stats[STATS_FLASH_ERASE], sim_stats.heap_peak, sim_stats.stack_peak);
+  }
+
   return 0;
 }
-
@@ -6,25 +6,108 @@
 //  Copyright (c) 2014 tim. All rights reserved.
 //
 
+#define _GNU_SOURCE // posix_openpt and friends on Linux
 #include <stdio.h>
 #include <unistd.h>
-#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "os.h"
 
+// -- Virtual time
+//  The simulator runs on a virtual clock so event heavy programs behave the same on every run and
+//  go as fast as the host allows. Each statement costs SIM_STATEMENT_USEC (BLUEBASIC_STATEMENT_USEC
+//  overrides it) and when the interpreter is idle the clock jumps to the next timer or scripted
+//  event. Piped input takes no time at all; once it runs out we carry on to the END of the event
+//  script (see below) or for BLUEBASIC_RUNTIME more ms, if either is given. When input comes from
+//  a terminal the clock follows real time while we wait for it instead. BLUEBASIC_MAX_STATEMENTS
+//  stops any program ("Break") once that many statements have run, so runaway loops can't hang us.
+//  sim_max_millis does the same at a fixed virtual time, and then ends the simulation there.
+
+#define SIM_STATEMENT_USEC  50
+#define SIM_FOREVER         (~0ULL)
+
+static unsigned long long simbase;
+static unsigned long simstatements;
+static unsigned long simcost = SIM_STATEMENT_USEC;
+static unsigned long long simend;
+static unsigned long long simruntime = SIM_FOREVER;
+static char simdone;
+static long simmillis;
+static char simscript;
+
+static unsigned long long sim_now(void)
+{
+  return simbase + (unsigned long long)(sim_stats.statements - simstatements) * simcost;
+}
+
+static void sim_advance(unsigned long long to)
+{
+  if (to > sim_now())
+  {
+    simbase = to;
+    simstatements = sim_stats.statements;
+  }
+}
+
+unsigned long OS_get_micros(void)
+{
+  return (unsigned long)sim_now();
+}
+
+long OS_get_millis(void)
+{
+  return (long)(sim_now() / 1000) + simmillis;
+}
+
+void OS_set_millis(long time)
+{
+  simmillis = time - (long)(sim_now() / 1000);
+}
+
+// When input runs out: BLUEBASIC_RUNTIME ms later, or else at the script's END (or last event)
+static unsigned long long sim_end(void)
+{
+  if (sim_max_millis)
+  {
+    return sim_max_millis * 1000ULL;
+  }
+  if (simruntime != SIM_FOREVER)
+  {
+    return sim_now() + simruntime;
+  }
+  return simend;
+}
+
 // Timers
-#define NR_TIMERS ((OS_MAX_TIMER) - 1)
-struct
+static struct
 {
   unsigned short lineno;
+  unsigned long interval; // usecs, 0 for one shot
+  unsigned long long due;
 } timers[OS_MAX_TIMER];
 
 os_discover_t blueBasic_discover;
+struct sim_stats sim_stats;
 
-static char alarmfire;
 static unsigned char* bstart;
 static unsigned char* bend;
 
-extern unsigned char __store[];
+// Console input from memory (see sim_input) rather than stdin
+static const unsigned char* siminput;
+static const unsigned char* siminputend;
+
+unsigned long sim_max_statements;
+unsigned long sim_max_millis;
+char sim_echo = 1;
+
+
+static void sim_start(void);
+static unsigned long long sim_next_due(void);
+static void sim_run_until(unsigned long long until);
 
 void OS_prompt_buffer(unsigned char* start, unsigned char* end)
 {
@@ -32,37 +115,110 @@ void OS_prompt_buffer(unsigned char* start, unsigned char* end)
   bend = end;
 }
 
+// Wait for console input, running everything that falls due meanwhile. Returns 0 when the
+// simulation is over.
+static char sim_wait_input(void)
+{
+  static char started;
+  static char interactive;
+
+  if (!started)
+  {
+    started = 1;
+    interactive = !siminput && isatty(0);
+    sim_start();
+  }
+  if (simdone)
+  {
+    return 0;
+  }
+  if (!interactive)
+  {
+    sim_run_until(sim_now());
+    return !simdone;
+  }
+  for (;;)
+  {
+    struct pollfd pfd = { 0, POLLIN };
+    struct timespec before, after;
+    const unsigned long long due = sim_next_due();
+    const unsigned long long now = sim_now();
+    int wait = -1;
+
+    if (due != SIM_FOREVER)
+    {
+      wait = due > now ? (int)((due - now + 999) / 1000) : 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &before);
+    const int ready = poll(&pfd, 1, wait);
+    clock_gettime(CLOCK_MONOTONIC, &after);
+    sim_run_until(now + (after.tv_sec - before.tv_sec) * 1000000ULL + (after.tv_nsec - before.tv_nsec) / 1000);
+    if (simdone)
+    {
+      return 0;
+    }
+    if (ready > 0)
+    {
+      return 1;
+    }
+  }
+}
+
+void sim_input(const unsigned char* data, unsigned long len)
+{
+  siminput = data;
+  siminputend = data + len;
+}
+
+static int sim_getchar(void)
+{
+  if (!siminput)
+  {
+    return getchar();
+  }
+  return siminput < siminputend ? *siminput++ : EOF;
+}
+
+char OS_breakcheck(void)
+{
+  return (sim_max_statements && sim_stats.statements >= sim_max_statements) ||
+         (sim_max_millis && sim_now() >= sim_max_millis * 1000ULL);
+}
+
 char OS_prompt_available(void)
 {
   char quote = 0;
   unsigned char* ptr = bstart;
 
+  if (!sim_wait_input())
+  {
+    return 0;
+  }
+
   for (;;)
   {
-    char c = getchar();
+    char c = sim_getchar();
     switch (c)
     {
       case -1:
-        if (feof(stdin))
-        {
-          return 0;
-        }
-        if (alarmfire)
-        {
-          alarmfire = 0;
-          timers[0].lineno && interpreter_run(timers[0].lineno, 1);
-          timers[1].lineno && interpreter_run(timers[1].lineno, 0);
-        }
-        break;
+        // Out of input - run on to the end of the simulation
+        sim_run_until(sim_end());
+        return 0;
       case '\n':
         OS_timer_stop(DELAY_TIMER); // Stop autorun
-        OS_putchar('\n');
+        if (sim_echo)
+        {
+          OS_putchar('\n');
+        }
         *ptr = '\n';
         return 1;
       default:
         if(ptr == bend)
         {
-          OS_putchar('\b');
+          if (sim_echo)
+          {
+            OS_putchar('\b');
+          }
         }
         else
         {
@@ -80,68 +236,240 @@ char OS_prompt_available(void)
             c = c + 'A' - 'a';
           }
           *ptr++ = c;
-          OS_putchar(c);
+          if (sim_echo)
+          {
+            OS_putchar(c);
+          }
         }
         break;
     }
   }
 }
 
-static void alarmhandler(int sig)
-{
-  alarmfire = 1;
-}
-
 void OS_timer_stop(unsigned char id)
 {
-  alarm(0);
-  alarmfire = 0;
   timers[id].lineno = 0;
 }
 
 char OS_timer_start(unsigned char id, unsigned long timeout, unsigned char repeat, unsigned short lineno)
 {
-  static char first = 1;
-  if (first)
-  {
-    first = 0;
-    alarmfire = 0;
-    struct sigaction act = { alarmhandler, 0, 0 };
-    sigaction(SIGALRM, &act, NULL);
-  }
   if (id >= OS_MAX_TIMER)
   {
     return 0;
   }
   timers[id].lineno = lineno;
-  ualarm((useconds_t)(timeout * 1000), repeat ? (useconds_t)(timeout * 1000) : 0);
+  timers[id].interval = repeat ? (timeout ? timeout : 1) * 1000 : 0;
+  timers[id].due = sim_now() + timeout * 1000ULL;
   return 1;
 }
 
 // -- BLE placeholders
+//  Registered services are remembered so scripted READ and WRITE events can reach their
+//  callbacks. Attribute handles are numbered from 1 in registration order, starting again once
+//  every service has gone. The built-in services (file transfer) are numbered from 0xF001 so
+//  they don't move the program's.
+//  Notifications are printed to stderr. Like the stack, only SIM_NOTIFY_BUFFERS of them go out
+//  every SIM_NOTIFY_INTERVAL; after that there's no buffer until the next interval.
+
+#define SIM_MAX_SERVICES    8
+#define SIM_BUILTIN_HANDLE  0xF000
+#define SIM_NOTIFY_BUFFERS  4
+#define SIM_NOTIFY_INTERVAL 10000 // us
+
+static struct
+{
+  gattAttribute_t* attrs;
+  unsigned short count;
+  const gattServiceCBs_t* callbacks;
+} simservices[SIM_MAX_SERVICES];
+static unsigned short simhandle;
 
 unsigned char GATTServApp_RegisterService(gattAttribute_t* attributes, unsigned short count, const void* callbacks)
 {
-  return SUCCESS;
+  for (unsigned char i = 0; i < SIM_MAX_SERVICES; i++)
+  {
+    if (!simservices[i].attrs)
+    {
+      for (unsigned short a = 0; a < count; a++)
+      {
+        attributes[a].handle = ++simhandle;
+      }
+      simservices[i].attrs = attributes;
+      simservices[i].count = count;
+      simservices[i].callbacks = callbacks;
+      return SUCCESS;
+    }
+  }
+  return FAILURE;
+}
+
+void sim_services(void)
+{
+#ifdef ENABLE_FILE_TRANSFER
+  const unsigned short handle = simhandle;
+  simhandle = SIM_BUILTIN_HANDLE;
+  transfer_init();
+  simhandle = handle;
+#endif
 }
 
 unsigned char GATTServApp_DeregisterService(unsigned short handle, void* attr)
 {
+  unsigned char left = 0;
+  for (unsigned char i = 0; i < SIM_MAX_SERVICES; i++)
+  {
+    if (simservices[i].attrs && simservices[i].attrs[0].handle == handle)
+    {
+      *(gattAttribute_t**)attr = simservices[i].attrs;
+      simservices[i].attrs = NULL;
+    }
+    left |= (simservices[i].attrs && simservices[i].attrs[0].handle < SIM_BUILTIN_HANDLE);
+  }
+  if (!left)
+  {
+    simhandle = 0;
+  }
   return SUCCESS;
 }
 
+typedef unsigned char (*sim_read_callback)(unsigned short handle, gattAttribute_t* attr, unsigned char* value, unsigned char* len, unsigned short offset, unsigned char maxlen);
+typedef unsigned char (*sim_write_callback)(unsigned short handle, gattAttribute_t* attr, unsigned char* value, unsigned char len, unsigned short offset);
+
+static gattAttribute_t* sim_find_attribute(unsigned short handle, const gattServiceCBs_t** callbacks)
+{
+  for (unsigned char i = 0; i < SIM_MAX_SERVICES; i++)
+  {
+    for (unsigned short a = 0; simservices[i].attrs && a < simservices[i].count; a++)
+    {
+      if (simservices[i].attrs[a].handle == handle)
+      {
+        *callbacks = simservices[i].callbacks;
+        return &simservices[i].attrs[a];
+      }
+    }
+  }
+  return NULL;
+}
+
 unsigned char GATTServApp_InitCharCfg(unsigned short handle, gattCharCfg_t* charcfgtbl)
 {
+  for (unsigned char i = 0; i < GATT_MAX_NUM_CONN; i++)
+  {
+    if (handle == 0xFFFF || charcfgtbl[i].connhandle == handle)
+    {
+      charcfgtbl[i].connhandle = 0xFFFF;
+      charcfgtbl[i].value = 0;
+    }
+  }
   return SUCCESS;
 }
 
+//
+// As the stack does, read the value through its service and notify each connection which
+// has turned notifications on.
+//
 unsigned char GATTServApp_ProcessCharCfg(gattCharCfg_t* charcfgtbl, void* pval, unsigned char auth, gattAttribute_t* attrs, unsigned short numattrs, unsigned char taskid)
 {
+  attHandleValueNoti_t noti;
+  const gattServiceCBs_t* callbacks;
+  gattAttribute_t* attr = NULL;
+
+  for (unsigned short a = 0; a < numattrs && !attr; a++)
+  {
+    if (attrs[a].pValue == pval)
+    {
+      attr = &attrs[a];
+    }
+  }
+  if (!attr || !sim_find_attribute(attr->handle, &callbacks))
+  {
+    return FAILURE;
+  }
+  noti.handle = attr->handle;
+  for (unsigned char i = 0; i < GATT_MAX_NUM_CONN; i++)
+  {
+    if (charcfgtbl[i].connhandle != INVALID_CONNHANDLE && (charcfgtbl[i].value & GATT_CLIENT_CFG_NOTIFY) &&
+        ((sim_read_callback)callbacks->read)(charcfgtbl[i].connhandle, attr, noti.value, &noti.len, 0, sizeof(noti.value)) == SUCCESS)
+    {
+      GATT_Notification(charcfgtbl[i].connhandle, &noti, auth);
+    }
+  }
   return SUCCESS;
 }
 
 unsigned char GATTServApp_ProcessCCCWriteReq(unsigned short handle, gattAttribute_t* attr, unsigned char* value, unsigned char len, unsigned short offset, unsigned short validcfg)
 {
+  gattCharCfg_t* charcfgtbl = (gattCharCfg_t*)attr->pValue;
+  gattCharCfg_t* slot = NULL;
+
+  if (offset || len != 2)
+  {
+    return offset ? ATT_ERR_INVALID_OFFSET : ATT_ERR_INVALID_VALUE_SIZE;
+  }
+  for (unsigned char i = 0; i < GATT_MAX_NUM_CONN; i++)
+  {
+    if (charcfgtbl[i].connhandle == handle)
+    {
+      slot = &charcfgtbl[i];
+      break;
+    }
+    if (!slot && charcfgtbl[i].connhandle == INVALID_CONNHANDLE)
+    {
+      slot = &charcfgtbl[i];
+    }
+  }
+  if (!slot)
+  {
+    return FAILURE;
+  }
+  slot->connhandle = handle;
+  slot->value = value[0] & validcfg;
+  return SUCCESS;
+}
+
+unsigned short GATTServApp_ReadCharCfg(unsigned short handle, gattCharCfg_t* charcfgtbl)
+{
+  for (unsigned char i = 0; i < GATT_MAX_NUM_CONN; i++)
+  {
+    if (charcfgtbl[i].connhandle == handle)
+    {
+      return charcfgtbl[i].value;
+    }
+  }
+  return 0;
+}
+
+static unsigned short simconnected[GATT_MAX_NUM_CONN] = { INVALID_CONNHANDLE, INVALID_CONNHANDLE, INVALID_CONNHANDLE };
+
+unsigned char GATT_Notification(unsigned short handle, attHandleValueNoti_t* noti, unsigned char authenticated)
+{
+  static unsigned long long interval;
+  static unsigned char sent;
+  unsigned char i;
+
+  for (i = 0; i < GATT_MAX_NUM_CONN && simconnected[i] != handle; i++)
+    ;
+  if (i == GATT_MAX_NUM_CONN)
+  {
+    fprintf(stderr, "NOTIFY %u TO %u: not connected\n", noti->handle, handle);
+    return bleNotConnected;
+  }
+  if (sim_now() / SIM_NOTIFY_INTERVAL != interval)
+  {
+    interval = sim_now() / SIM_NOTIFY_INTERVAL;
+    sent = 0;
+  }
+  if (sent == SIM_NOTIFY_BUFFERS)
+  {
+    return MSG_BUFFER_NOT_AVAIL;
+  }
+  sent++;
+  fprintf(stderr, "NOTIFY %u TO %u:", noti->handle, handle);
+  for (i = 0; i < noti->len; i++)
+  {
+    fprintf(stderr, " %02X", noti->value[i]);
+  }
+  fprintf(stderr, "\n");
   return SUCCESS;
 }
 
@@ -211,64 +539,1461 @@ unsigned char GAPRole_TerminateConnection(void)
   return SUCCESS;
 }
 
+// The flash is kept in this file, mapped into memory so every write lands in it straight away
+// (and it's the same image the device keeps; see Tools/flashimage.c). Without a file it's kept
+// in memory, and whatever is in __store when the interpreter starts is used as is.
+const char* sim_flashstore = "/tmp/flashstore";
+static unsigned char* simflashmem; // __store's own memory, while a file is mapped
+
+// Erase every page and give them their starting ages
+void sim_flashstore_format(void)
+{
+  int lastage = 1;
+  const unsigned char* ptr;
+  memset(__store, 0xFF, FLASHSTORE_LEN);
+  for (ptr = __store; ptr < &__store[FLASHSTORE_LEN]; ptr += FLASHSTORE_PAGESIZE)
+  {
+    *(int*)ptr = lastage++;
+  }
+}
+
 void OS_flashstore_init(void)
 {
-  FILE* fp = fopen("/tmp/flashstore", "r");
-  if (fp)
+  struct stat st;
+  void* map;
+  int fd;
+
+  if (simflashmem)
   {
-    fread(__store, FLASHSTORE_LEN, sizeof(char), fp);
-    fclose(fp);
+    munmap(__store, FLASHSTORE_LEN);
+    __store = simflashmem;
+    simflashmem = NULL;
   }
-  else
+  if (!sim_flashstore)
   {
-    int lastage = 1;
-    const unsigned char* ptr;
-    memset(__store, 0xFF, FLASHSTORE_LEN);
-    for (ptr = __store; ptr < &__store[FLASHSTORE_LEN]; ptr += FLASHSTORE_PAGESIZE)
-    {
-      *(int*)ptr = lastage++;
-    }
-    
+    return;
+  }
+  fd = open(sim_flashstore, O_RDWR | O_CREAT, 0644);
+  if (fd < 0 || fstat(fd, &st) || (st.st_size < FLASHSTORE_LEN && ftruncate(fd, FLASHSTORE_LEN)))
+  {
+    perror(sim_flashstore);
+    exit(1);
+  }
+  map = mmap(NULL, FLASHSTORE_LEN, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+  {
+    perror(sim_flashstore);
+    exit(1);
+  }
+  simflashmem = __store;
+  __store = map;
+  if (st.st_size == 0)
+  {
+    sim_flashstore_format();
+  }
+  else if (st.st_size < FLASHSTORE_LEN)
+  {
+    // A short image is padded with erased flash
+    memset(__store + st.st_size, 0xFF, FLASHSTORE_LEN - st.st_size);
   }
 }
 
 void OS_flashstore_write(unsigned long faddr, unsigned char* value, unsigned char sizeinwords)
 {
+  STATS_COUNT(STATS_FLASH_WRITE);
   memcpy(&__store[faddr << 2], value, sizeinwords << 2);
-  FILE* fp = fopen("/tmp/flashstore", "w");
-  fwrite(__store, FLASHSTORE_LEN, sizeof(char), fp);
-  fclose(fp);
 }
 
 void OS_flashstore_erase(unsigned long page)
 {
+  STATS_COUNT(STATS_FLASH_ERASE);
   memset(&__store[page << 11], 0xFF, FLASHSTORE_PAGESIZE);
-  FILE* fp = fopen("/tmp/flashstore", "w");
-  fwrite(__store, FLASHSTORE_LEN, sizeof(char), fp);
-  fclose(fp);
 }
 
-unsigned char OS_serial_open(unsigned char port, unsigned long baud, unsigned char parity, unsigned char bits, unsigned char stop, unsigned char flow, unsigned short onread, unsigned short onwrite)
+// Longest program line we'll load (it must fit, with its newline, in 255 bytes)
+#define SIM_MAX_LINE  254
+
+// Console input to load a program: NEW and its numbered lines (anything else is left out) and
+// then RUN if asked. Either part can be skipped.
+
+unsigned char* sim_program_input(const char* program, char run, unsigned long* len)
+{
+  static const char newcmd[] = "NEW\n";
+  static const char runcmd[] = "RUN\n";
+  unsigned long size = sizeof(newcmd) + sizeof(runcmd);
+  unsigned char* input;
+  char* line = NULL;
+  size_t linecap = 0;
+  FILE* fp = NULL;
+
+  if (program)
+  {
+    fp = fopen(program, "r");
+    if (!fp)
+    {
+      perror(program);
+      exit(1);
+    }
+    fseek(fp, 0, SEEK_END);
+    size += ftell(fp) + 1;
+    rewind(fp);
+  }
+  input = malloc(size);
+  *len = 0;
+  if (fp)
+  {
+    memcpy(input, newcmd, sizeof(newcmd) - 1);
+    *len = sizeof(newcmd) - 1;
+    for (unsigned long lineno = 1; getline(&line, &linecap, fp) != -1; lineno++)
+    {
+      const char* ptr = line + strspn(line, " \t");
+      size_t linelen = strcspn(ptr, "\r\n");
+      if (*ptr >= '0' && *ptr <= '9')
+      {
+        if (linelen > SIM_MAX_LINE)
+        {
+          // The interpreter keeps a line's length in a byte, so rather than split it we stop
+          fprintf(stderr, "%s:%lu: line longer than %d characters\n", program, lineno, SIM_MAX_LINE);
+          exit(1);
+        }
+        memcpy(input + *len, ptr, linelen);
+        *len += linelen;
+        input[(*len)++] = '\n';
+      }
+    }
+    free(line);
+    fclose(fp);
+  }
+  if (run)
+  {
+    memcpy(input + *len, runcmd, sizeof(runcmd) - 1);
+    *len += sizeof(runcmd) - 1;
+  }
+  return input;
+}
+
+// -- Simulated serial ports
+//  Port 0 is a loopback: everything written is received again, so framing and block transfers
+//  can be exercised. Port 1 is backed by a pseudo terminal (its name is printed to stderr when
+//  opened) so real data can be pushed through it. The line counts as idle whenever we are back
+//  at the prompt.
+
+static struct
+{
+  unsigned short onread;
+  unsigned char* rxbuf;
+  unsigned short rxsize;
+  unsigned short rxhead;
+  unsigned short rxlen;
+  short delimiter;
+  unsigned short count;
+  unsigned short idle;
+  unsigned short frames;
+  int pty;
+} simserial[OS_MAX_SERIAL];
+
+static void serial_receive(unsigned char port, unsigned char* buf, unsigned short len)
+{
+  for (; len && simserial[port].rxlen < simserial[port].rxsize; len--)
+  {
+    unsigned short pos = (simserial[port].rxhead + simserial[port].rxlen) % simserial[port].rxsize;
+    if (simserial[port].delimiter != OS_SERIAL_NODELIMITER && *buf == (unsigned char)simserial[port].delimiter)
+    {
+      simserial[port].frames++;
+    }
+    simserial[port].rxbuf[pos] = *buf++;
+    simserial[port].rxlen++;
+  }
+}
+
+static void serial_fill(unsigned char port)
+{
+  unsigned char buf[256];
+  if (simserial[port].pty > 0 && simserial[port].rxlen < simserial[port].rxsize)
+  {
+    unsigned short space = simserial[port].rxsize - simserial[port].rxlen;
+    ssize_t len = read(simserial[port].pty, buf, space < sizeof(buf) ? space : sizeof(buf));
+    if (len > 0)
+    {
+      serial_receive(port, buf, len);
+    }
+  }
+}
+
+unsigned char OS_serial_open(unsigned char port, unsigned long baud, unsigned char parity, unsigned char bits, unsigned char stop, unsigned char flow, unsigned short rxsize, unsigned short onread, unsigned short onwrite)
 {
+  if (baud < OS_SERIAL_MIN_BAUD || baud > OS_SERIAL_MAX_BAUD)
+  {
+    return 2;
+  }
+  if (port >= OS_MAX_SERIAL || bits != 8 || (stop != 1 && stop != 2) || (flow != 'H' && flow != 'N') || (parity != 'N' && parity != 'E' && parity != 'O'))
+  {
+    return 3;
+  }
+  OS_serial_close(port);
+  if (port == 1)
+  {
+    simserial[port].pty = posix_openpt(O_RDWR | O_NOCTTY);
+    if (simserial[port].pty < 0 || grantpt(simserial[port].pty) || unlockpt(simserial[port].pty))
+    {
+      return 1;
+    }
+    struct termios tio;
+    tcgetattr(simserial[port].pty, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(simserial[port].pty, TCSANOW, &tio);
+    fcntl(simserial[port].pty, F_SETFL, O_NONBLOCK);
+    fprintf(stderr, "SERIAL #1: %s\n", ptsname(simserial[port].pty));
+  }
+  simserial[port].rxsize = rxsize ? rxsize : OS_SERIAL_RXBUF;
+  simserial[port].rxbuf = malloc(simserial[port].rxsize);
+  simserial[port].onread = onread;
   return 0;
 }
 
+void OS_serial_framing(unsigned char port, short delimiter, unsigned short count, unsigned short idle)
+{
+  simserial[port].delimiter = delimiter;
+  simserial[port].count = count;
+  simserial[port].idle = idle;
+  simserial[port].frames = 0;
+}
+
 unsigned char OS_serial_close(unsigned char port)
 {
-  return 0;
+  if (simserial[port].pty > 0)
+  {
+    close(simserial[port].pty);
+  }
+  free(simserial[port].rxbuf);
+  memset(&simserial[port], 0, sizeof(simserial[port]));
+  simserial[port].delimiter = OS_SERIAL_NODELIMITER;
+  return 1;
+}
+
+unsigned short OS_serial_read_block(unsigned char port, unsigned char* buf, unsigned short len)
+{
+  unsigned short total = 0;
+  serial_fill(port);
+  for (; len && simserial[port].rxlen; len--, total++)
+  {
+    unsigned char ch = simserial[port].rxbuf[simserial[port].rxhead];
+    if (simserial[port].frames && ch == (unsigned char)simserial[port].delimiter)
+    {
+      simserial[port].frames--;
+    }
+    *buf++ = ch;
+    simserial[port].rxlen--;
+    if (++simserial[port].rxhead == simserial[port].rxsize)
+    {
+      simserial[port].rxhead = 0;
+    }
+    if (!simserial[port].rxlen)
+    {
+      serial_fill(port);
+    }
+  }
+  return total;
+}
+
+unsigned short OS_serial_write_block(unsigned char port, unsigned char* buf, unsigned short len)
+{
+  if (simserial[port].pty > 0)
+  {
+    ssize_t wrote = write(simserial[port].pty, buf, len);
+    return wrote > 0 ? wrote : 0;
+  }
+  if (!simserial[port].rxbuf)
+  {
+    return 0;
+  }
+  unsigned short before = simserial[port].rxlen;
+  serial_receive(port, buf, len);
+  return simserial[port].rxlen - before;
 }
 
 short OS_serial_read(unsigned char port)
 {
-  return 255;
+  unsigned char ch;
+  return OS_serial_read_block(port, &ch, 1) == 1 ? ch : -1;
 }
 
 unsigned char OS_serial_write(unsigned char port, unsigned char ch)
 {
-  return 0;
+  return OS_serial_write_block(port, &ch, 1);
 }
 
-unsigned char OS_serial_available(unsigned char port, unsigned char ch)
+unsigned short OS_serial_available(unsigned char port, unsigned char ch)
 {
+  if (ch == 'R')
+  {
+    serial_fill(port);
+    return simserial[port].rxlen;
+  }
   return 0;
 }
+
+unsigned char OS_serial_ready(unsigned char port)
+{
+  serial_fill(port);
+  if (!simserial[port].rxlen)
+  {
+    return 0;
+  }
+  if (simserial[port].frames || simserial[port].idle || simserial[port].rxlen == simserial[port].rxsize || (simserial[port].count && simserial[port].rxlen >= simserial[port].count))
+  {
+    return 1;
+  }
+  return simserial[port].delimiter == OS_SERIAL_NODELIMITER && !simserial[port].count;
+}
+
+static void serial_dispatch(void)
+{
+  for (unsigned char port = 0; port < OS_MAX_SERIAL; port++)
+  {
+    while (simserial[port].onread && OS_serial_ready(port))
+    {
+      unsigned short before = simserial[port].rxlen;
+      STATS_COUNT(STATS_EVENT_SERIAL);
+      interpreter_run(simserial[port].onread, 1);
+      if (simserial[port].rxlen == before)
+      {
+        break;
+      }
+    }
+  }
+}
+
+// -- Simulated pin interrupts
+//  Without an event script, every pin sees a burst of three edges, 10ms apart, as soon as it is
+//  attached; with one, pins only see the edges it lists. They are queued just as the port ISRs
+//  queue them and dispatched when we are next back at the prompt.
+
+#define SIM_PIN_EDGES 3
+
+static struct
+{
+  unsigned char pin;
+  unsigned short linenum;
+} siminterrupts[OS_MAX_INTERRUPT];
+
+static struct
+{
+  unsigned char id;
+  long time;
+} simpinevents[OS_MAX_PINEVENT];
+static unsigned char simpinhead;
+static unsigned char simpintail;
+static unsigned char simpinread;
+static unsigned char simpinid = OS_PINEVENT_TAKEN;
+
+#define SIMPIN_NEXT(I)  (((I) + 1) & (OS_MAX_PINEVENT - 1))
+
+char OS_interrupt_attach(unsigned char pin, unsigned short lineno)
+{
+  for (unsigned char i = 0; i < OS_MAX_INTERRUPT; i++)
+  {
+    if (siminterrupts[i].linenum == 0)
+    {
+      siminterrupts[i].pin = pin;
+      siminterrupts[i].linenum = lineno;
+      const long now = OS_get_millis();
+      for (unsigned char e = 0; !simscript && e < SIM_PIN_EDGES && SIMPIN_NEXT(simpintail) != simpinhead; e++)
+      {
+        simpinevents[simpintail].id = i;
+        simpinevents[simpintail].time = now + e * 10;
+        simpintail = SIMPIN_NEXT(simpintail);
+      }
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// A scripted edge on a pin
+static unsigned char sim_pin_edge(unsigned char pin)
+{
+  unsigned char queued = 0;
+  for (unsigned char i = 0; i < OS_MAX_INTERRUPT; i++)
+  {
+    if (siminterrupts[i].linenum && siminterrupts[i].pin == pin && SIMPIN_NEXT(simpintail) != simpinhead)
+    {
+      simpinevents[simpintail].id = i;
+      simpinevents[simpintail].time = OS_get_millis();
+      simpintail = SIMPIN_NEXT(simpintail);
+      queued = 1;
+    }
+  }
+  return queued;
+}
+
+char OS_interrupt_detach(unsigned char pin)
+{
+  for (unsigned char i = 0; i < OS_MAX_INTERRUPT; i++)
+  {
+    if (siminterrupts[i].linenum && siminterrupts[i].pin == pin)
+    {
+      siminterrupts[i].pin = 0;
+      siminterrupts[i].linenum = 0;
+      // Its queued events mustn't reach whatever attaches here next
+      for (unsigned char e = simpinhead; e != simpintail; e = SIMPIN_NEXT(e))
+      {
+        if (simpinevents[e].id == i)
+        {
+          simpinevents[e].id = OS_PINEVENT_TAKEN;
+        }
+      }
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// As on the device, only the events queued when we start; sim_run_until calls us again for the rest
+void OS_interrupt_dispatch(void)
+{
+  const unsigned char tail = simpintail;
+
+  while (simpinhead != tail)
+  {
+    const unsigned char id = simpinevents[simpinhead].id;
+    if (id != OS_PINEVENT_TAKEN && siminterrupts[id].linenum)
+    {
+      simpinid = id;
+      simpinread = simpinhead;
+      STATS_COUNT(STATS_EVENT_PIN);
+      interpreter_run(siminterrupts[id].linenum, 1);
+      simpinid = OS_PINEVENT_TAKEN;
+    }
+    simpinhead = SIMPIN_NEXT(simpinhead);
+  }
+}
+
+unsigned char OS_interrupt_read(long* time)
+{
+  if (simpinid == OS_PINEVENT_TAKEN)
+  {
+    return 0;
+  }
+  for (; simpinread != simpintail; simpinread = SIMPIN_NEXT(simpinread))
+  {
+    if (simpinevents[simpinread].id == simpinid)
+    {
+      *time = simpinevents[simpinread].time;
+      simpinevents[simpinread].id = OS_PINEVENT_TAKEN;
+      simpinread = SIMPIN_NEXT(simpinread);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// -- Simulated Timer 1 counters
+//  A counter sees five edges, 250 ticks (1ms at the default divider) apart, as soon as it starts.
+
+os_counter_t blueBasic_counters[OS_MAX_COUNTER];
+
+void OS_counter_edges(unsigned char channel)
+{
+  blueBasic_counters[channel].count = 5;
+  blueBasic_counters[channel].last = 5 * 250;
+  blueBasic_counters[channel].period = 250;
+}
+
+// -- Simulated I2C slave
+//  A 256 byte EEPROM-like device at address 0x50 (0xA0 on the wire). Writing sets the register
+//  pointer followed by data; reading returns data from the register pointer. Both auto-increment.
+
+#define I2C_SLAVE_ADDRESS 0x50
+
+enum
+{
+  I2C_IDLE,
+  I2C_ADDRESS,
+  I2C_WRITE,
+  I2C_ACK,
+  I2C_READ,
+  I2C_READ_ACK
+};
+
+static struct
+{
+  unsigned char state;
+  unsigned char next;
+  unsigned char scl;
+  unsigned char sda;
+  unsigned char drive;
+  unsigned char bit;
+  unsigned char byte;
+  unsigned char first;
+  unsigned char nack;
+  unsigned char reg;
+  unsigned char mem[256];
+} i2cslave = { I2C_IDLE, I2C_IDLE, 1, 1, 1 };
+
+unsigned char OS_i2c_bus(unsigned char scl, unsigned char sda)
+{
+  unsigned char bus = sda & i2cslave.drive;
+
+  if (scl && i2cslave.scl)
+  {
+    // SDA changing while SCL is high is a START or STOP
+    if (i2cslave.sda && !bus)
+    {
+      i2cslave.state = I2C_ADDRESS;
+      i2cslave.bit = 0;
+      i2cslave.byte = 0;
+    }
+    else if (!i2cslave.sda && bus)
+    {
+      i2cslave.state = I2C_IDLE;
+    }
+  }
+  else if (scl && !i2cslave.scl)
+  {
+    // Rising edge - sample
+    switch (i2cslave.state)
+    {
+      case I2C_ADDRESS:
+      case I2C_WRITE:
+        i2cslave.byte = (i2cslave.byte << 1) | bus;
+        i2cslave.bit++;
+        break;
+      case I2C_READ_ACK:
+        i2cslave.nack = bus;
+        break;
+      default:
+        break;
+    }
+  }
+  else if (!scl && i2cslave.scl)
+  {
+    // Falling edge - setup the next bit
+    switch (i2cslave.state)
+    {
+      case I2C_ADDRESS:
+        if (i2cslave.bit == 8)
+        {
+          if ((i2cslave.byte >> 1) == I2C_SLAVE_ADDRESS)
+          {
+            i2cslave.drive = 0;
+            i2cslave.state = I2C_ACK;
+            i2cslave.next = (i2cslave.byte & 1 ? I2C_READ : I2C_WRITE);
+            i2cslave.first = 1;
+          }
+          else
+          {
+            i2cslave.state = I2C_IDLE;
+          }
+        }
+        break;
+      case I2C_WRITE:
+        if (i2cslave.bit == 8)
+        {
+          if (i2cslave.first)
+          {
+            i2cslave.reg = i2cslave.byte;
+            i2cslave.first = 0;
+          }
+          else
+          {
+            i2cslave.mem[i2cslave.reg++] = i2cslave.byte;
+          }
+          i2cslave.drive = 0;
+          i2cslave.state = I2C_ACK;
+          i2cslave.next = I2C_WRITE;
+        }
+        break;
+      case I2C_ACK:
+        i2cslave.drive = 1;
+        i2cslave.state = i2cslave.next;
+        i2cslave.bit = 0;
+        i2cslave.byte = 0;
+        if (i2cslave.state == I2C_READ)
+        {
+          i2cslave.byte = i2cslave.mem[i2cslave.reg++];
+          i2cslave.drive = i2cslave.byte >> 7;
+        }
+        break;
+      case I2C_READ:
+        if (++i2cslave.bit == 8)
+        {
+          i2cslave.drive = 1;
+          i2cslave.state = I2C_READ_ACK;
+        }
+        else
+        {
+          i2cslave.drive = (i2cslave.byte >> (7 - i2cslave.bit)) & 1;
+        }
+        break;
+      case I2C_READ_ACK:
+        if (i2cslave.nack)
+        {
+          i2cslave.state = I2C_IDLE;
+        }
+        else
+        {
+          i2cslave.bit = 0;
+          i2cslave.byte = i2cslave.mem[i2cslave.reg++];
+          i2cslave.drive = i2cslave.byte >> 7;
+          i2cslave.state = I2C_READ;
+        }
+        break;
+      default:
+        break;
+    }
+  }
+  i2cslave.scl = scl;
+  i2cslave.sda = sda & i2cslave.drive;
+  return i2cslave.sda;
+}
+
+// -- Simulated SPI devices
+//  USART0 has an MB85RS64V (8K FRAM) attached. USART1 has its MISO and MOSI looped back.
+
+#define FRAM_SIZE 8192
+
+static struct
+{
+  unsigned char selected;
+  unsigned char cmd;
+  unsigned char count;
+  unsigned char wel;
+  unsigned char status;
+  unsigned short addr;
+  unsigned char mem[FRAM_SIZE];
+} fram;
+
+static const unsigned char fram_id[] = { 0x04, 0x7F, 0x03, 0x02 };
+
+void OS_spi_select(unsigned char channel, unsigned char select)
+{
+  if (channel == 0)
+  {
+    if (!select && fram.selected && fram.cmd == 0x02)
+    {
+      fram.wel = 0;
+    }
+    fram.selected = select;
+    fram.cmd = 0;
+    fram.count = 0;
+  }
+}
+
+unsigned char OS_spi_exchange(unsigned char channel, unsigned char data)
+{
+  unsigned char out = 0;
+
+  if (channel != 0)
+  {
+    return data;
+  }
+  if (!fram.selected)
+  {
+    return 0xFF;
+  }
+  if (fram.count == 0)
+  {
+    fram.cmd = data;
+    fram.count = 1;
+    switch (data)
+    {
+      case 0x06: // WREN
+        fram.wel = 1;
+        break;
+      case 0x04: // WRDI
+        fram.wel = 0;
+        break;
+    }
+    return 0;
+  }
+  switch (fram.cmd)
+  {
+    case 0x05: // RDSR
+      out = fram.status | (fram.wel << 1);
+      break;
+    case 0x01: // WRSR
+      if (fram.wel && fram.count == 1)
+      {
+        fram.status = data & 0x8C;
+      }
+      break;
+    case 0x9F: // RDID
+      out = (fram.count <= sizeof(fram_id) ? fram_id[fram.count - 1] : 0);
+      break;
+    case 0x03: // READ
+    case 0x02: // WRITE
+      if (fram.count == 1)
+      {
+        fram.addr = data << 8;
+      }
+      else if (fram.count == 2)
+      {
+        fram.addr |= data;
+      }
+      else
+      {
+        if (fram.cmd == 0x03)
+        {
+          out = fram.mem[fram.addr];
+        }
+        else if (fram.wel)
+        {
+          fram.mem[fram.addr] = data;
+        }
+        fram.addr = (fram.addr + 1) % FRAM_SIZE;
+      }
+      break;
+  }
+  if (fram.count < 255)
+  {
+    fram.count++;
+  }
+  return out;
+}
+
+// -- Simulated ADC
+//  Every conversion returns the next step of a sawtooth (0, 1, 2 ... 127 at 8-bit resolution).
+//  Results are left justified, as the hardware does.
+
+static unsigned char adc_sample;
+
+unsigned short OS_adc_convert(unsigned char channel)
+{
+  return (adc_sample++ & 0x7F) << 8;
+}
+
+// -- Simulated 1-Wire bus
+//  Two DS18B20 temperature sensors (25.0625C and -10.125C) share the WIRE pin. We're called once
+//  per reset and once per time slot with the bit the master wrote; the devices pull the bus low
+//  as they would on the wire, so READ ROM with both present gives the AND of their codes.
+
+enum
+{
+  OW_IDLE,
+  OW_ROM,
+  OW_MATCH,
+  OW_SEARCH,
+  OW_FUNCTION,
+  OW_SEND,
+};
+
+static struct
+{
+  unsigned char rom[8];
+  unsigned char scratchpad[9];
+  unsigned char active;
+} ds18b20[2] =
+{
+  { { 0x28, 0x61, 0x64, 0x11, 0x8D, 0x4C, 0x3A }, { 0x91, 0x01, 0x4B, 0x46, 0x7F, 0xFF, 0x0F, 0x10 } },
+  { { 0x28, 0xFF, 0x4B, 0x03, 0x15, 0x15, 0x02 }, { 0x5E, 0xFF, 0x4B, 0x46, 0x7F, 0xFF, 0x02, 0x10 } },
+};
+
+static struct
+{
+  unsigned char state;
+  unsigned char pos;
+  unsigned char step;
+  unsigned char data;
+  unsigned char scratchpad;
+} onewire;
+
+static unsigned char onewire_crc(unsigned char* data, unsigned char len)
+{
+  unsigned char crc = 0;
+  while (len--)
+  {
+    crc ^= *data++;
+    for (unsigned char b = 8; b; b--)
+    {
+      crc = (crc & 1) ? (crc >> 1) ^ 0x8C : crc >> 1;
+    }
+  }
+  return crc;
+}
+
+unsigned char OS_onewire_reset(void)
+{
+  for (unsigned char d = 0; d < 2; d++)
+  {
+    ds18b20[d].rom[7] = onewire_crc(ds18b20[d].rom, 7);
+    ds18b20[d].scratchpad[8] = onewire_crc(ds18b20[d].scratchpad, 8);
+    ds18b20[d].active = 1;
+  }
+  onewire.state = OW_ROM;
+  onewire.pos = 0;
+  onewire.data = 0;
+  return 1;
+}
+
+unsigned char OS_onewire_bit(unsigned char bit)
+{
+  unsigned char bus = bit;
+
+  for (unsigned char d = 0; d < 2; d++)
+  {
+    if (!ds18b20[d].active)
+    {
+      continue;
+    }
+    const unsigned char* src = onewire.scratchpad ? ds18b20[d].scratchpad : ds18b20[d].rom;
+    const unsigned char mine = (src[onewire.pos >> 3] >> (onewire.pos & 7)) & 1;
+    switch (onewire.state)
+    {
+      case OW_MATCH:
+        ds18b20[d].active = (mine == bit);
+        break;
+      case OW_SEARCH:
+        if (onewire.step == 0)
+        {
+          bus &= mine;
+        }
+        else if (onewire.step == 1)
+        {
+          bus &= !mine;
+        }
+        else
+        {
+          ds18b20[d].active = (mine == bit);
+        }
+        break;
+      case OW_SEND:
+        if (onewire.pos < (onewire.scratchpad ? 72 : 64))
+        {
+          bus &= mine;
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+  switch (onewire.state)
+  {
+    case OW_ROM:
+    case OW_FUNCTION:
+      onewire.data |= bit << (onewire.pos++ & 7);
+      if (onewire.pos == 8)
+      {
+        const unsigned char cmd = onewire.data;
+        onewire.pos = 0;
+        onewire.data = 0;
+        onewire.scratchpad = (onewire.state == OW_FUNCTION);
+        switch (cmd)
+        {
+          case 0x33: // READ ROM
+            onewire.state = OW_SEND;
+            break;
+          case 0x55: // MATCH ROM
+            onewire.state = OW_MATCH;
+            break;
+          case 0xCC: // SKIP ROM
+            onewire.state = OW_FUNCTION;
+            break;
+          case 0xF0: // SEARCH ROM
+            onewire.state = OW_SEARCH;
+            onewire.step = 0;
+            break;
+          case 0xBE: // READ SCRATCHPAD
+            onewire.state = (onewire.scratchpad ? OW_SEND : OW_IDLE);
+            break;
+          default: // CONVERT T (finishes at once) and everything else
+            onewire.state = OW_IDLE;
+            break;
+        }
+      }
+      break;
+    case OW_MATCH:
+      if (++onewire.pos == 64)
+      {
+        onewire.pos = 0;
+        onewire.state = OW_FUNCTION;
+      }
+      break;
+    case OW_SEARCH:
+      if (++onewire.step == 3)
+      {
+        onewire.step = 0;
+        if (++onewire.pos == 64)
+        {
+          onewire.pos = 0;
+          onewire.state = OW_FUNCTION;
+        }
+      }
+      break;
+    case OW_SEND:
+      if (onewire.pos < 255)
+      {
+        onewire.pos++;
+      }
+      break;
+    default:
+      break;
+  }
+  return bus;
+}
+
+// -- Simulated DHT22
+//  Replies with 65.2% humidity at 23.5C. We return the length (in WIRE PULSE counts) of each
+//  successive level after the host releases the line: the idle high, the sensor's response low and
+//  high, then a low and a short or long high for every bit.
+
+static unsigned char dht_pulse;
+
+unsigned short OS_dht_pulse(void)
+{
+  static const unsigned char reading[5] = { 0x02, 0x8C, 0x00, 0xEB, 0x79 };
+  const unsigned char i = dht_pulse;
+
+  dht_pulse = (dht_pulse + 1) % 83;
+  if (i < 3)
+  {
+    return i ? 26 : 10;
+  }
+  const unsigned char bit = (i - 3) >> 1;
+  if (!((i - 3) & 1))
+  {
+    return 16;
+  }
+  return (reading[bit >> 3] & (0x80 >> (bit & 7))) ? 23 : 9;
+}
+
+// -- Scripted events
+//  BLUEBASIC_EVENTS names a file of events to inject, one per line, in time order:
+//
+//    <time> PIN Px(y) [<count> [<interval>]]   edges on an attached pin (default 1, 10ms apart)
+//    <time> SERIAL <port> "<text>"             bytes received (\n, \r, \" and \xHH escapes)
+//    <time> SCAN <address> <rssi> [<data>]     advert seen while SCANning (hex address and data)
+//    <time> CONNECT <handle>                   connection opened
+//    <time> DISCONNECT <handle>                connection closed
+//    <time> CLIENT <handle>                    later READs and WRITEs come from this connection
+//    <time> RSSI <handle> <rssi>               RSSI reported for a connection
+//    <time> READ <attribute> [<offset>]        client read (the value is printed to stderr)
+//    <time> WRITE <attribute> <data>           client write (hex data)
+//    <time> END                                stop the simulation
+//
+//  Handles and attributes are decimal, or hex starting 0x (the file transfer service's are at
+//  0xF001: its control value is 0xF003 and the data's CCC 0xF006). READ fetches the whole value
+//  from the offset with a read and then read blobs, and a WRITE of more than 20 bytes arrives as
+//  a long (prepared) write, a part at a time.
+//  Up to GATT_MAX_NUM_CONN clients can be connected at once. READs and WRITEs come from the last
+//  one CONNECTed unless CLIENT picks another, and notifications print as NOTIFY <attribute> TO
+//  <handle>.
+//  Times are in ms (with no suffix or ms), or s, m or h with that suffix, and are relative to the
+//  previous event when they start with '+'. Blank lines and lines starting with '#' are ignored.
+//  Events with the same time all reach the stack before the program handles any of them.
+//
+//  Events aren't held back for the program: like the real hardware, a pin edge with no INTERRUPT
+//  ATTACHed or serial data for a port that isn't open when it falls due is lost (with a note on
+//  stderr).
+
+enum
+{
+  SIM_PIN,
+  SIM_SERIAL,
+  SIM_SCAN,
+  SIM_CONNECT,
+  SIM_DISCONNECT,
+  SIM_CLIENT,
+  SIM_RSSI,
+  SIM_READ,
+  SIM_WRITE,
+  SIM_END,
+};
+
+#define SIM_MAX_DATA  64
+
+typedef struct
+{
+  unsigned long long due;
+  unsigned char type;
+  unsigned char arg;     // Pin or port
+  unsigned short handle; // Connection or attribute
+  unsigned short offset; // Where a read starts
+  signed char rssi;
+  unsigned char len;
+  unsigned char* data;
+} sim_event;
+
+static sim_event* simevents;
+static unsigned int simnrevents;
+static unsigned int simnext;
+static unsigned short simconnection;
+static unsigned long long simtransferdue = SIM_FOREVER;
+static unsigned long long simwritedue = SIM_FOREVER;
+static unsigned long long simcapturedue = SIM_FOREVER;
+static unsigned long simcaptureinterval;
+
+void OS_transfer_event(unsigned short ms)
+{
+  simtransferdue = sim_now() + ms * 1000ULL;
+}
+
+void OS_write_event(void)
+{
+  simwritedue = sim_now();
+}
+
+void OS_capture_start(unsigned short ms)
+{
+  simcaptureinterval = ms * 1000UL;
+  simcapturedue = sim_now() + simcaptureinterval;
+}
+
+void OS_capture_stop(void)
+{
+  simcapturedue = SIM_FOREVER;
+}
+
+static unsigned long long sim_parse_time(char** pos, unsigned long long last)
+{
+  char* str = *pos;
+  const char relative = (*str == '+');
+  unsigned long long time = strtoull(str + relative, &str, 10) * 1000;
+
+  // The result is in microseconds; a number with no suffix, or with ms, is milliseconds
+  if (str[0] == 'm' && str[1] == 's')
+  {
+    *pos = str + 2;
+    return relative ? last + time : time;
+  }
+  switch (*str)
+  {
+    case 'h':
+      time *= 60;
+      // Fall through
+    case 'm':
+      time *= 60;
+      // Fall through
+    case 's':
+      time *= 1000;
+      str++;
+      break;
+  }
+  *pos = str;
+  return relative ? last + time : time;
+}
+
+static unsigned char sim_parse_hex(char** pos, unsigned char* data)
+{
+  unsigned char len = 0;
+  char* str = *pos;
+  unsigned int byte;
+  int used;
+
+  while (*str == ' ' || *str == '\t')
+  {
+    str++;
+  }
+  while (len < SIM_MAX_DATA && sscanf(str, "%2x%n", &byte, &used) == 1 && used == 2)
+  {
+    data[len++] = byte;
+    str += used;
+    if (*str == ':')
+    {
+      str++;
+    }
+  }
+  *pos = str;
+  return len;
+}
+
+static unsigned char sim_parse_string(char* str, unsigned char* data)
+{
+  unsigned char len = 0;
+  unsigned int byte;
+
+  str = strchr(str, '"');
+  if (!str)
+  {
+    return 0;
+  }
+  for (str++; *str && *str != '"' && len < SIM_MAX_DATA; str++)
+  {
+    if (*str != '\\')
+    {
+      data[len++] = *str;
+      continue;
+    }
+    switch (*++str)
+    {
+      case 'n':
+        data[len++] = '\n';
+        break;
+      case 'r':
+        data[len++] = '\r';
+        break;
+      case 'x':
+        if (sscanf(str + 1, "%2x", &byte) == 1)
+        {
+          data[len++] = byte;
+          str += 2;
+        }
+        break;
+      default:
+        data[len++] = *str;
+        break;
+    }
+  }
+  return len;
+}
+
+// Insert an event, keeping them in time order (and in script order for the same time)
+static void sim_add_event(sim_event* event)
+{
+  unsigned int i;
+
+  simevents = realloc(simevents, (simnrevents + 1) * sizeof(sim_event));
+  for (i = simnrevents; i > 0 && simevents[i - 1].due > event->due; i--)
+  {
+    simevents[i] = simevents[i - 1];
+  }
+  simevents[i] = *event;
+  simnrevents++;
+}
+
+static void sim_load_events(const char* name)
+{
+  FILE* fp = fopen(name, "r");
+  char line[256];
+  unsigned int lineno = 0;
+  unsigned long long last = 0;
+
+  if (!fp)
+  {
+    fprintf(stderr, "EVENTS: cannot open %s\n", name);
+    exit(1);
+  }
+  simscript = 1;
+  while (fgets(line, sizeof(line), fp))
+  {
+    sim_event event = { 0 };
+    unsigned char data[8 + SIM_MAX_DATA];
+    char what[16];
+    char* pos = line;
+    int used = 0;
+    unsigned int major = 0;
+    unsigned int minor = 0;
+    unsigned int count = 1;
+    unsigned long long interval = 10000;
+    int value = 0;
+
+    lineno++;
+    pos += strspn(pos, " \t");
+    if (*pos == '#' || *pos == '\n' || !*pos)
+    {
+      continue;
+    }
+    event.due = last = sim_parse_time(&pos, last);
+    if (sscanf(pos, " %15s%n", what, &used) != 1)
+    {
+      goto bad;
+    }
+    pos += used;
+    if (!strcasecmp(what, "PIN") && sscanf(pos, " P%u(%u)%n", &major, &minor, &used) == 2 && major < 3 && minor < 8)
+    {
+      event.type = SIM_PIN;
+      event.arg = PIN_MAKE(major, minor);
+      pos += used;
+      if (sscanf(pos, " %u%n", &count, &used) == 1)
+      {
+        pos += used;
+        pos += strspn(pos, " \t");
+        if (*pos >= '0' && *pos <= '9')
+        {
+          interval = sim_parse_time(&pos, 0);
+        }
+      }
+    }
+    else if (!strcasecmp(what, "SERIAL") && sscanf(pos, " %d", &value) == 1 && value >= 0 && value < OS_MAX_SERIAL)
+    {
+      event.type = SIM_SERIAL;
+      event.arg = value;
+      event.len = sim_parse_string(pos, data);
+    }
+    else if (!strcasecmp(what, "SCAN") && sim_parse_hex(&pos, data) == 6 && sscanf(pos, " %d%n", &value, &used) == 1)
+    {
+      // The address (padded to the 8 bytes B() is given) followed by the advert data
+      event.type = SIM_SCAN;
+      event.rssi = value;
+      pos += used;
+      data[6] = data[7] = 0;
+      event.len = 8 + sim_parse_hex(&pos, data + 8);
+    }
+    else if ((!strcasecmp(what, "CONNECT") || !strcasecmp(what, "DISCONNECT") || !strcasecmp(what, "CLIENT") || !strcasecmp(what, "RSSI") || !strcasecmp(what, "READ") || !strcasecmp(what, "WRITE")) && sscanf(pos, " %i%n", &value, &used) == 1)
+    {
+      event.type = (!strcasecmp(what, "CONNECT") ? SIM_CONNECT : !strcasecmp(what, "DISCONNECT") ? SIM_DISCONNECT : !strcasecmp(what, "CLIENT") ? SIM_CLIENT :
+                    !strcasecmp(what, "RSSI") ? SIM_RSSI : !strcasecmp(what, "READ") ? SIM_READ : SIM_WRITE);
+      event.handle = value;
+      pos += used;
+      if (event.type == SIM_WRITE)
+      {
+        event.len = sim_parse_hex(&pos, data);
+      }
+      else if (event.type == SIM_READ && sscanf(pos, " %i%n", &value, &used) == 1)
+      {
+        event.offset = value;
+        pos += used;
+      }
+      else if (event.type == SIM_RSSI)
+      {
+        if (sscanf(pos, " %d%n", &value, &used) != 1)
+        {
+          goto bad;
+        }
+        event.rssi = value;
+        pos += used;
+      }
+    }
+    else if (!strcasecmp(what, "END"))
+    {
+      event.type = SIM_END;
+    }
+    else
+    {
+      goto bad;
+    }
+    if (event.len)
+    {
+      event.data = malloc(event.len);
+      memcpy(event.data, data, event.len);
+    }
+    for (; count; count--, event.due += interval)
+    {
+      sim_add_event(&event);
+    }
+    continue;
+bad:
+    fprintf(stderr, "EVENTS: %s:%u: cannot parse: %s", name, lineno, line);
+    exit(1);
+  }
+  fclose(fp);
+  if (simnrevents)
+  {
+    simend = simevents[simnrevents - 1].due;
+  }
+}
+
+static void sim_start(void)
+{
+  const char* env;
+
+  if ((env = getenv("BLUEBASIC_STATEMENT_USEC")))
+  {
+    simcost = strtoul(env, NULL, 10);
+  }
+  if ((env = getenv("BLUEBASIC_RUNTIME")))
+  {
+    simruntime = strtoull(env, NULL, 10) * 1000;
+  }
+  if ((env = getenv("BLUEBASIC_MAX_STATEMENTS")))
+  {
+    sim_max_statements = strtoul(env, NULL, 10);
+  }
+  if ((env = getenv("BLUEBASIC_EVENTS")) && *env)
+  {
+    sim_load_events(env);
+  }
+}
+
+// Replace one connected handle with another (INVALID_CONNHANDLE for a free slot)
+static void sim_connected(unsigned short from, unsigned short to)
+{
+  for (unsigned char i = 0; i < GATT_MAX_NUM_CONN; i++)
+  {
+    if (simconnected[i] == from)
+    {
+      simconnected[i] = to;
+      return;
+    }
+  }
+}
+
+static unsigned long long sim_next_due(void)
+{
+  unsigned long long due = (simnext < simnrevents ? simevents[simnext].due : SIM_FOREVER);
+
+  if (simtransferdue < due)
+  {
+    due = simtransferdue;
+  }
+  if (simwritedue < due)
+  {
+    due = simwritedue;
+  }
+  if (simcapturedue < due)
+  {
+    due = simcapturedue;
+  }
+
+  for (unsigned char i = 0; i < OS_MAX_TIMER; i++)
+  {
+    if (timers[i].lineno && timers[i].due < due)
+    {
+      due = timers[i].due;
+    }
+  }
+  return due;
+}
+
+static void sim_dispatch(sim_event* event)
+{
+  gattAttribute_t* attr;
+  const gattServiceCBs_t* callbacks;
+  unsigned char value[SIM_MAX_DATA];
+  unsigned char len = 0;
+  unsigned char status;
+  unsigned short offset;
+
+  switch (event->type)
+  {
+    case SIM_PIN:
+      if (!sim_pin_edge(event->arg))
+      {
+        fprintf(stderr, "PIN P%u(%u): nothing attached, edge dropped at %ldms\n", PIN_MAJOR(event->arg), PIN_MINOR(event->arg), OS_get_millis());
+      }
+      break;
+    case SIM_SERIAL:
+      if (simserial[event->arg].rxbuf)
+      {
+        serial_receive(event->arg, event->data, event->len);
+      }
+      else
+      {
+        fprintf(stderr, "SERIAL %u: not open, %u bytes dropped at %ldms\n", event->arg, event->len, OS_get_millis());
+      }
+      break;
+    case SIM_SCAN:
+      interpreter_devicefound(0, event->data, event->rssi, 0, event->len - 8, event->data + 8);
+      break;
+    case SIM_CONNECT:
+      simconnection = event->handle;
+      sim_connected(INVALID_CONNHANDLE, event->handle);
+      ble_connection_status(event->handle, LINKDB_STATUS_UPDATE_NEW, 0);
+      break;
+    case SIM_DISCONNECT:
+      sim_connected(event->handle, INVALID_CONNHANDLE);
+#ifdef ENABLE_FILE_TRANSFER
+      transfer_disconnect(event->handle);
+#endif
+      ble_connection_status(event->handle, LINKDB_STATUS_UPDATE_REMOVED, 0);
+      break;
+    case SIM_CLIENT:
+      simconnection = event->handle;
+      break;
+    case SIM_RSSI:
+      ble_connection_status(event->handle, LINKDB_STATUS_UPDATE_RSSI, event->rssi);
+      break;
+    case SIM_READ:
+      // A read, then read blobs until the value runs out, as a client does for a long value
+      attr = sim_find_attribute(event->handle, &callbacks);
+      fprintf(stderr, "READ %u:", event->handle);
+      offset = event->offset;
+      do
+      {
+        status = (attr ? ((sim_read_callback)callbacks->read)(simconnection, attr, value, &len, offset, ATT_MTU_SIZE - 1) : FAILURE);
+        for (unsigned char i = 0; status == SUCCESS && i < len; i++)
+        {
+          fprintf(stderr, " %02X", value[i]);
+        }
+        offset += len;
+      } while (status == SUCCESS && len == ATT_MTU_SIZE - 1);
+      if (status != SUCCESS)
+      {
+        fprintf(stderr, " failed (%u)", status);
+      }
+      fprintf(stderr, "\n");
+      break;
+    case SIM_WRITE:
+      // Values too long for one write go as prepared writes, which the stack delivers part by
+      // part when the client executes them
+      attr = sim_find_attribute(event->handle, &callbacks);
+      if (!attr)
+      {
+        status = FAILURE;
+      }
+      else if (event->len <= ATT_MTU_SIZE - 3)
+      {
+        status = ((sim_write_callback)callbacks->write)(simconnection, attr, event->data, event->len, 0);
+      }
+      else
+      {
+        status = SUCCESS;
+        for (offset = 0; status == SUCCESS && offset < event->len; offset += len)
+        {
+          len = (event->len - offset < ATT_MTU_SIZE - 5 ? event->len - offset : ATT_MTU_SIZE - 5);
+          status = ((sim_write_callback)callbacks->write)(simconnection, attr, event->data + offset, len, offset);
+        }
+      }
+      if (status != SUCCESS)
+      {
+        fprintf(stderr, "WRITE %u: failed (%u)\n", event->handle, status);
+      }
+      break;
+    case SIM_END:
+      simdone = 1;
+      break;
+  }
+}
+
+// Run everything that falls due up to 'until', in time order, advancing the clock as we go
+static void sim_run_until(unsigned long long until)
+{
+  for (;;)
+  {
+    serial_dispatch();
+    OS_interrupt_dispatch();
+    const unsigned long long due = sim_next_due();
+    if (simdone || due > until || OS_breakcheck())
+    {
+      break;
+    }
+    sim_advance(due);
+    sim_stats.events++;
+
+    unsigned char id;
+    for (id = 0; id < OS_MAX_TIMER && !(timers[id].lineno && timers[id].due == due); id++)
+      ;
+    if (id < OS_MAX_TIMER)
+    {
+      const unsigned short lineno = timers[id].lineno;
+      if (timers[id].interval)
+      {
+        timers[id].due += timers[id].interval;
+      }
+      else
+      {
+        timers[id].lineno = 0;
+      }
+      STATS_COUNT(STATS_EVENT_TIMER);
+      interpreter_run(lineno, id == DELAY_TIMER ? 0 : 1);
+    }
+    else if (simnext < simnrevents && simevents[simnext].due == due)
+    {
+      // The stack's tasks outrank ours, so everything it receives at once is delivered first
+      sim_dispatch(&simevents[simnext++]);
+    }
+    else if (simwritedue == due)
+    {
+      simwritedue = SIM_FOREVER;
+      ble_write_complete();
+    }
+    else if (simcapturedue == due)
+    {
+      simcapturedue += simcaptureinterval;
+      interpreter_capture();
+    }
+#ifdef ENABLE_FILE_TRANSFER
+    else if (simtransferdue == due)
+    {
+      simtransferdue = SIM_FOREVER;
+      transfer_send();
+    }
+#endif
+  }
+  if (!simdone && until != SIM_FOREVER)
+  {
+    sim_advance(until);
+  }
+}
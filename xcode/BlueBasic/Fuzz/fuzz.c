@@ -0,0 +1,56 @@
+//
+//  fuzz.c
+//  BlueBasic
+//
+//  Shared setup for the fuzzing harnesses. The simulator keeps the flash in memory and its
+//  console output goes to /dev/null (set BLUEBASIC_FUZZ_VERBOSE to see it).
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "fuzz.h"
+
+void fuzz_start(void)
+{
+  static char started;
+
+  if (!started)
+  {
+    started = 1;
+    sim_flashstore = NULL;
+    if (!getenv("BLUEBASIC_FUZZ_VERBOSE"))
+    {
+      freopen("/dev/null", "w", stdout);
+    }
+  }
+  sim_flashstore_format();
+  sim_max_statements = sim_stats.statements + FUZZ_MAX_STATEMENTS;
+  interpreter_setup();
+}
+
+void fuzz_console(const unsigned char* data, size_t size)
+{
+  sim_input(data, size);
+  interpreter_loop();
+}
+
+void fuzz_finish(void)
+{
+  static const unsigned char reset[] = "PROFILE OFF\nNEW\n";
+
+  // NEW stops timers and clears the stack, heap and BLE services; serial ports and pin
+  // interrupts outlive it
+  sim_max_statements = 0;
+  fuzz_console(reset, sizeof(reset) - 1);
+  for (unsigned char port = 0; port < OS_MAX_SERIAL; port++)
+  {
+    OS_serial_close(port);
+  }
+  for (unsigned char major = 0; major < 3; major++)
+  {
+    for (unsigned char minor = 0; minor < 8; minor++)
+    {
+      OS_interrupt_detach(PIN_MAKE(major, minor));
+    }
+  }
+}
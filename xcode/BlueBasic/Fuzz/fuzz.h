@@ -0,0 +1,31 @@
+//
+//  fuzz.h
+//  BlueBasic
+//
+//  Fuzzing entry points. Each harness defines LLVMFuzzerTestOneInput, so it can be linked
+//  with libFuzzer (or AFL++'s libFuzzer driver), or with fuzz_main.c which runs each file
+//  named on the command line once (how AFL runs it, and how ctest replays the corpus).
+//
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "os.h"
+
+// Statements each input may run before the program is stopped with "Break"
+#define FUZZ_MAX_STATEMENTS 100000
+
+// A harness's own checks. Unlike assert these stay in with NDEBUG (the release builds the
+// fuzzers usually run), and abort so the fuzzer keeps the input.
+#define FUZZ_CHECK(C) \
+  do { if (!(C)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #C); abort(); } } while (0)
+
+extern int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+// Start the interpreter on freshly formatted (memory only) flash
+extern void fuzz_start(void);
+// Type the data at the console, as the user would, and run whatever it asks for
+extern void fuzz_console(const unsigned char* data, size_t size);
+// Put back anything the input left behind that the next one would see
+extern void fuzz_finish(void);
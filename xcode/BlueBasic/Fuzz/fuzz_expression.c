@@ -0,0 +1,45 @@
+//
+//  fuzz_expression.c
+//  BlueBasic
+//
+//  Expression evaluator: the input is a single expression which is printed, assigned and
+//  run from a program line, so the number parser and every operator and function get it.
+//
+
+#include <string.h>
+#include "fuzz.h"
+
+#define FUZZ_MAX_EXPRESSION 200
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+  static const char* const forms[] = { "PRINT ", "\nA = ", "\n10 B = ", "\nRUN\n" };
+  unsigned char input[4 * FUZZ_MAX_EXPRESSION];
+  unsigned char expr[FUZZ_MAX_EXPRESSION];
+  size_t len = 0;
+
+  if (size > FUZZ_MAX_EXPRESSION)
+  {
+    size = FUZZ_MAX_EXPRESSION;
+  }
+  // Keep it to one line
+  for (size_t i = 0; i < size; i++)
+  {
+    expr[i] = (data[i] == '\n' ? ' ' : data[i]);
+  }
+  for (unsigned char f = 0; f < sizeof(forms) / sizeof(forms[0]); f++)
+  {
+    memcpy(input + len, forms[f], strlen(forms[f]));
+    len += strlen(forms[f]);
+    if (f < 3)
+    {
+      memcpy(input + len, expr, size);
+      len += size;
+    }
+  }
+
+  fuzz_start();
+  fuzz_console(input, len);
+  fuzz_finish();
+  return 0;
+}
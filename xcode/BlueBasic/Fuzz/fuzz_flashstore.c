@@ -0,0 +1,46 @@
+//
+//  fuzz_flashstore.c
+//  BlueBasic
+//
+//  Flash store: the input is a flash image (padded with erased flash). The rebuilt line index
+//  must only point at whole lines inside the store, in order, and the interpreter must then
+//  be able to list and run whatever program it finds.
+//
+
+#include <string.h>
+#include "fuzz.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+  static const unsigned char commands[] = "LIST\nRUN\n";
+  static unsigned char* lines[FLASHSTORE_LEN / 4]; // Smallest item is 4 bytes
+  unsigned char** end;
+
+  fuzz_start();
+  if (size > FLASHSTORE_LEN)
+  {
+    size = FLASHSTORE_LEN;
+  }
+  memset(__store, 0xFF, FLASHSTORE_LEN);
+  memcpy(__store, data, size);
+
+  end = flashstore_init(lines);
+  for (unsigned char** line = lines; line < end; line++)
+  {
+    const unsigned char* item = *line;
+    const unsigned char* page = __store + (item - __store) / FLASHSTORE_PAGESIZE * FLASHSTORE_PAGESIZE;
+    FUZZ_CHECK(item >= __store && item + item[sizeof(unsigned short)] <= page + FLASHSTORE_PAGESIZE);
+    FUZZ_CHECK(line == lines || *(unsigned short*)line[-1] <= *(unsigned short*)item);
+  }
+  flashstore_findspecial(FLASHSPECIAL_AUTORUN);
+  flashstore_findclosest(1);
+  flashstore_findclosest(0xFFFD);
+  flashstore_freemem();
+  flashstore_wastemem();
+
+  // Restart the interpreter on this image
+  interpreter_setup();
+  fuzz_console(commands, sizeof(commands) - 1);
+  fuzz_finish();
+  return 0;
+}
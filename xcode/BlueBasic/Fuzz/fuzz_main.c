@@ -0,0 +1,60 @@
+//
+//  fuzz_main.c
+//  BlueBasic
+//
+//  Runs a fuzzing harness once for each file named on the command line (or for stdin) when
+//  it isn't linked with libFuzzer. This is enough for AFL, and for replaying a corpus.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "fuzz.h"
+
+static int fuzz_file(const char* name, FILE* fp)
+{
+  size_t size = 0;
+  size_t len = 4096;
+  unsigned char* data = malloc(len);
+
+  for (size_t n; (n = fread(data + size, 1, len - size, fp)) > 0; )
+  {
+    size += n;
+    if (size == len)
+    {
+      len *= 2;
+      data = realloc(data, len);
+    }
+  }
+  if (ferror(fp))
+  {
+    fprintf(stderr, "%s: read failed\n", name);
+    free(data);
+    return 1;
+  }
+  LLVMFuzzerTestOneInput(data, size);
+  free(data);
+  return 0;
+}
+
+int main(int argc, const char* argv[])
+{
+  int failed = 0;
+
+  if (argc < 2)
+  {
+    return fuzz_file("stdin", stdin);
+  }
+  for (int i = 1; i < argc; i++)
+  {
+    FILE* fp = fopen(argv[i], "rb");
+    if (!fp)
+    {
+      fprintf(stderr, "%s: can't open\n", argv[i]);
+      failed = 1;
+      continue;
+    }
+    failed |= fuzz_file(argv[i], fp);
+    fclose(fp);
+  }
+  return failed;
+}
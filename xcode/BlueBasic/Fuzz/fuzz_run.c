@@ -0,0 +1,17 @@
+//
+//  fuzz_run.c
+//  BlueBasic
+//
+//  Tokenizer and interpreter: the input is typed at the console, so lines with numbers are
+//  tokenized into the program and everything else is run directly (including RUN).
+//
+
+#include "fuzz.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+  fuzz_start();
+  fuzz_console(data, size);
+  fuzz_finish();
+  return 0;
+}
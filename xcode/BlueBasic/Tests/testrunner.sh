@@ -1,4 +1,4 @@
-#!/bin/sh
+#!/bin/bash
 
 #  testrunner.sh
 #  BlueBasic
@@ -6,14 +6,34 @@
 #  Created by tim on 7/15/14.
 #  Copyright (c) 2014 tim. All rights reserved.
 
-BLUEBASIC="$HOME/Library/Developer/Xcode/DerivedData/BlueBasic-*/Build/Products/Debug/BlueBasic"
+#  Usage: testrunner.sh [-j jobs] [-u] [test ...]
+#  Runs the named tests, or every test listed in 'tests'. Set BLUEBASIC to
+#  pick the interpreter binary (the CMake build does this for ctest).
+#
+#  Each test gets its own simulator and flash image, so they run in parallel
+#  (-j, default one per core). Every failure is reported with a diff, and each
+#  test's wall time and statement count are printed. Statement counts don't
+#  depend on the machine (the simulator runs on a virtual clock) so they are
+#  checked against 'baseline': a test running more than BLUEBASIC_TOLERANCE
+#  percent (default 10) more statements is a regression. -u writes the counts
+#  of the tests just run into 'baseline' instead.
+#
+#  A test may also have a $test.stderr file, which must match what the simulator
+#  writes to stderr (notifications and the like), less its STATS line.
 
-for test in $(cat tests)
-do
+BLUEBASIC=${BLUEBASIC:-$(echo $HOME/Library/Developer/Xcode/DerivedData/BlueBasic-*/Build/Products/Debug/BlueBasic)}
+TOLERANCE=${BLUEBASIC_TOLERANCE:-10}
+
+# Run one test into the work directory: writes $test.result (SUCCESS or FAILURE),
+# $test.time (seconds), $test.stats (simulator STATS line) and $test.diff
+if [ "$1" = "--one" ]
+then
+  test=$2
+  work=$3
   exec < $test.test
   input=""
   expected=""
-  while read line
+  while IFS= read -r line
   do
     if [ "$line" = '.' ]
     then
@@ -25,17 +45,93 @@ $line"
     fi
   done
   expected=${expected:1} # remove first newline
-  rm -f /tmp/flashstore
-  result=$(echo "${input:1}" | $BLUEBASIC | sed '1,4d') # remove startup header
+  events=""
+  if [ -f $test.events ]
+  then
+    events=$test.events # scripted events for the simulator
+  fi
+  echo "${input:1}" > $work/$test.in
+  TIMEFORMAT=%R
+  { time BLUEBASIC_STATS=1 BLUEBASIC_EVENTS=$events BLUEBASIC_FLASHSTORE=$work/$test.flash \
+      $BLUEBASIC < $work/$test.in > $work/$test.out 2> $work/$test.err ; } 2> $work/$test.time
+  result=$(sed '1,4d' $work/$test.out) # remove startup header
+  grep '^STATS:' $work/$test.err > $work/$test.stats
+  if [ -f $test.stderr ]
+  then
+    # Fold the simulator's stderr into what we compare
+    expected="$expected
+$(cat $test.stderr)"
+    result="$result
+$(grep -v '^STATS:' $work/$test.err)"
+  fi
   if [ "$result" = "$expected" ]
   then
-    echo "** $test: SUCCESS"
+    echo SUCCESS > $work/$test.result
   else
-    echo "** $test: FAILURE"
-    echo "Result:
-'$result'
-Expected:
-'$expected'"
-    exit 1
+    echo FAILURE > $work/$test.result
+    echo "$expected" > $work/$test.expected
+    echo "$result" > $work/$test.actual
+    diff -u --label expected --label result $work/$test.expected $work/$test.actual > $work/$test.diff
   fi
+  exit 0
+fi
+
+jobs=$(getconf _NPROCESSORS_ONLN 2>/dev/null || echo 1)
+update=""
+while getopts "j:u" opt
+do
+  case $opt in
+    j) jobs=$OPTARG ;;
+    u) update=1 ;;
+    *) exit 2 ;;
+  esac
 done
+shift $((OPTIND - 1))
+
+tests=${@:-$(cat tests)}
+work=$(mktemp -d "${TMPDIR:-/tmp}/bluebasic-tests.XXXXXX")
+trap "rm -rf $work" EXIT
+
+printf '%s\n' $tests | xargs -P $jobs -I {} bash "$0" --one {} $work
+
+# Report in the order given, and collect 'name statements' for the baseline
+failures=0
+regressions=0
+for test in $tests
+do
+  result=$(cat $work/$test.result 2>/dev/null || echo FAILURE)
+  ms=$(awk '{ printf "%d", $1 * 1000 }' $work/$test.time 2>/dev/null)
+  statements=$(sed -n 's/.* statements=\([0-9]*\).*/\1/p' $work/$test.stats 2>/dev/null)
+  echo "$test ${statements:-0}" >> $work/counts
+  echo "** $test: $result (${ms:-0}ms, ${statements:-0} statements)"
+  if [ "$result" != "SUCCESS" ]
+  then
+    failures=$((failures + 1))
+    cat $work/$test.diff 2>/dev/null
+    sed -n '/^STATS:/!p' $work/$test.err 2>/dev/null
+  fi
+done
+
+if [ -n "$update" ]
+then
+  # Keep the counts for tests we didn't run
+  touch baseline
+  awk 'NR == FNR { n[$1] = $2; next } { if (!($1 in n)) n[$1] = $2 } END { for (t in n) print t, n[t] }' \
+    $work/counts baseline | sort > $work/baseline
+  mv $work/baseline baseline
+  echo "** baseline updated"
+elif [ -f baseline ]
+then
+  awk -v tolerance=$TOLERANCE 'NR == FNR { n[$1] = $2; next }
+    ($1 in n) && $2 * 100 > n[$1] * (100 + tolerance) {
+      printf "** %s: REGRESSION (%d statements, baseline %d)\n", $1, $2, n[$1]
+    }' baseline $work/counts > $work/regressions
+  cat $work/regressions
+  regressions=$(wc -l < $work/regressions)
+fi
+
+if [ $failures -gt 0 ] || [ $regressions -gt 0 ]
+then
+  echo "** $failures failed, $((regressions)) regressed"
+  exit 1
+fi
@@ -0,0 +1,297 @@
+//
+//  flashimage.c
+//  BlueBasic
+//
+//  Converts between BASIC source and flash store images. An image is the flash store exactly
+//  as the device keeps it (FLASHSTORE_NRPAGES pages of FLASHSTORE_PAGESIZE, little endian),
+//  so it can be used by the simulator (BLUEBASIC_FLASHSTORE) or written to a device at its
+//  flash store address (FLASHSTORE_DMA_BASEADDR).
+//
+//  The images we write are compacted and ordered: each item appears once, program lines first
+//  in line order and then the specials (autorun, files, SNV), packed from the oldest page.
+//  Lines are tokenized by the interpreter itself, so they're exactly what typing them in
+//  would have stored.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "os.h"
+
+extern void interpreter_setup(void);
+extern void interpreter_loop(void);
+
+// Same layout as BlueBasic_Flashstore.c: <age:4> then <id:2><len:1><data> items padded to 4 bytes
+#define PAGE_AGE        sizeof(unsigned int)
+#define ITEMSIZE(PTR)   ((PTR)[sizeof(unsigned short)] ? ((PTR)[sizeof(unsigned short)] + 3) & -4 : 4)
+
+static const char* const usage =
+  "usage: flashimage build program.bbasic image     tokenize a program into a new image\n"
+  "       flashimage list image [program.bbasic]    turn an image back into source\n"
+  "       flashimage compact image newimage         rewrite an image compacted and ordered\n"
+  "       flashimage time image [runs]              time rebuilding the line index at boot\n";
+
+static void load_image(const char* name)
+{
+  FILE* fp = fopen(name, "rb");
+  size_t len;
+
+  if (!fp)
+  {
+    perror(name);
+    exit(1);
+  }
+  memset(__store, 0xFF, FLASHSTORE_LEN);
+  len = fread(__store, 1, FLASHSTORE_LEN, fp);
+  fclose(fp);
+  if (len < PAGE_AGE)
+  {
+    fprintf(stderr, "%s: not a flash image\n", name);
+    exit(1);
+  }
+}
+
+static void save_image(const char* name, const unsigned char* image)
+{
+  FILE* fp = fopen(name, "wb");
+
+  if (!fp || fwrite(image, 1, FLASHSTORE_LEN, fp) != FLASHSTORE_LEN || fclose(fp))
+  {
+    perror(name);
+    exit(1);
+  }
+}
+
+// Type at the interpreter's console, with what it prints going to 'out' (or nowhere)
+static void console(const unsigned char* input, unsigned long len, FILE* out)
+{
+  FILE* null = fopen("/dev/null", "w");
+  int saved;
+
+  fflush(stdout);
+  saved = dup(1);
+  dup2(fileno(out ? out : null), 1);
+  sim_input(input, len);
+  interpreter_loop();
+  fflush(stdout);
+  dup2(saved, 1);
+  close(saved);
+  fclose(null);
+}
+
+static void start_interpreter(void)
+{
+  FILE* null = fopen("/dev/null", "w");
+  int saved;
+
+  // Keep the banner quiet
+  fflush(stdout);
+  saved = dup(1);
+  dup2(fileno(null), 1);
+  interpreter_setup();
+  fflush(stdout);
+  dup2(saved, 1);
+  close(saved);
+  fclose(null);
+}
+
+// Add an item to the image at pos, moving on to the next page when it doesn't fit. Returns 0
+// when the image is full.
+static char copy_item(unsigned char* image, unsigned char** pos, const unsigned char* item)
+{
+  const unsigned short size = ITEMSIZE(item);
+  unsigned char* page = image + (*pos - image) / FLASHSTORE_PAGESIZE * FLASHSTORE_PAGESIZE;
+
+  if (*pos + size > page + FLASHSTORE_PAGESIZE)
+  {
+    page += FLASHSTORE_PAGESIZE;
+    if (page == image + FLASHSTORE_LEN)
+    {
+      return 0;
+    }
+    *pos = page + PAGE_AGE;
+  }
+  memcpy(*pos, item, size);
+  *pos += size;
+  return 1;
+}
+
+// Write what's in __store to a new image: lines in order, then the specials by page age
+static void pack_image(const char* name)
+{
+  static unsigned char* lines[FLASHSTORE_LEN / 4];
+  unsigned char image[FLASHSTORE_LEN];
+  unsigned char* pos = image + PAGE_AGE;
+  unsigned char** end;
+  unsigned char** line;
+  unsigned int age;
+  unsigned int pg;
+
+  memset(image, 0xFF, FLASHSTORE_LEN);
+  for (pg = 0; pg < FLASHSTORE_NRPAGES; pg++)
+  {
+    *(unsigned int*)(image + pg * FLASHSTORE_PAGESIZE) = pg + 1;
+  }
+
+  sim_flashstore = NULL;
+  end = flashstore_init(lines);
+  for (line = lines; line < end; line++)
+  {
+    if (!copy_item(image, &pos, *line))
+    {
+      goto full;
+    }
+  }
+  for (age = 0; age != 0xFFFFFFFF; )
+  {
+    // Next oldest page
+    unsigned int next = 0xFFFFFFFF;
+    for (pg = 0; pg < FLASHSTORE_NRPAGES; pg++)
+    {
+      const unsigned int a = *(unsigned int*)(__store + pg * FLASHSTORE_PAGESIZE);
+      if (a > age && a < next)
+      {
+        next = a;
+      }
+    }
+    age = next;
+    for (pg = 0; pg < FLASHSTORE_NRPAGES; pg++)
+    {
+      const unsigned char* page = __store + pg * FLASHSTORE_PAGESIZE;
+      const unsigned char* ptr;
+      if (*(unsigned int*)page != age)
+      {
+        continue;
+      }
+      for (ptr = page + PAGE_AGE; ptr < page + FLASHSTORE_PAGESIZE && ptr + ITEMSIZE(ptr) <= page + FLASHSTORE_PAGESIZE; ptr += ITEMSIZE(ptr))
+      {
+        const unsigned short id = *(unsigned short*)ptr;
+        if (id == FLASHID_FREE)
+        {
+          break;
+        }
+        if (id == FLASHID_SPECIAL && !copy_item(image, &pos, ptr))
+        {
+          goto full;
+        }
+      }
+    }
+  }
+  save_image(name, image);
+  return;
+
+full:
+  fprintf(stderr, "%s: doesn't fit in %u bytes of flash\n", name, FLASHSTORE_LEN);
+  exit(1);
+}
+
+static int build(const char* program, const char* image)
+{
+  unsigned long len;
+  unsigned char* input;
+
+  sim_flashstore = NULL;
+  sim_flashstore_format();
+  sim_echo = 0;
+  start_interpreter();
+  input = sim_program_input(program, 0, &len);
+  console(input, len, NULL);
+  free(input);
+  pack_image(image);
+  return 0;
+}
+
+static int list(const char* image, const char* program)
+{
+  static const unsigned char listcmd[] = "LIST\n";
+  static const char ok[] = "OK\n";
+  FILE* tmp = tmpfile();
+  FILE* out = (program ? fopen(program, "w") : stdout);
+  char line[2][512];
+  unsigned long n;
+
+  if (!tmp || !out)
+  {
+    perror(program ? program : "tmpfile");
+    return 1;
+  }
+  sim_flashstore = NULL;
+  load_image(image);
+  sim_echo = 0;
+  start_interpreter();
+  console(listcmd, sizeof(listcmd) - 1, tmp);
+
+  // Everything but the final OK
+  rewind(tmp);
+  for (n = 0; fgets(line[n & 1], sizeof(line[0]), tmp); n++)
+  {
+    if (n)
+    {
+      fputs(line[(n - 1) & 1], out);
+    }
+  }
+  if (n && strcmp(line[(n - 1) & 1], ok))
+  {
+    fputs(line[(n - 1) & 1], out);
+  }
+  fclose(tmp);
+  if (out != stdout)
+  {
+    fclose(out);
+  }
+  return 0;
+}
+
+static int compact(const char* image, const char* newimage)
+{
+  load_image(image);
+  pack_image(newimage);
+  return 0;
+}
+
+static int time_index(const char* image, unsigned long runs)
+{
+  static unsigned char* lines[FLASHSTORE_LEN / 4];
+  unsigned char** end = lines;
+  unsigned long i;
+  clock_t start;
+  double usec;
+
+  if (!runs)
+  {
+    runs = 1;
+  }
+  sim_flashstore = NULL;
+  load_image(image);
+  start = clock();
+  for (i = 0; i < runs; i++)
+  {
+    end = flashstore_init(lines);
+  }
+  usec = (clock() - start) * 1000000.0 / CLOCKS_PER_SEC / runs;
+  printf("{\"image\":\"%s\",\"lines\":%u,\"runs\":%lu,\"init_usec\":%.3f,\"free\":%u,\"waste\":%u}\n",
+         image, (unsigned)(end - lines), runs, usec, flashstore_freemem(), flashstore_wastemem());
+  return 0;
+}
+
+int main(int argc, const char* argv[])
+{
+  if (argc == 4 && !strcmp(argv[1], "build"))
+  {
+    return build(argv[2], argv[3]);
+  }
+  if ((argc == 3 || argc == 4) && !strcmp(argv[1], "list"))
+  {
+    return list(argv[2], argc == 4 ? argv[3] : NULL);
+  }
+  if (argc == 4 && !strcmp(argv[1], "compact"))
+  {
+    return compact(argv[2], argv[3]);
+  }
+  if ((argc == 3 || argc == 4) && !strcmp(argv[1], "time"))
+  {
+    return time_index(argv[2], argc == 4 ? strtoul(argv[3], NULL, 10) : 10000);
+  }
+  fputs(usage, stderr);
+  return 2;
+}
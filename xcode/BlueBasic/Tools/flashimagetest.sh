@@ -0,0 +1,37 @@
+#!/bin/bash
+
+#  flashimagetest.sh
+#  BlueBasic
+#
+#  Usage: flashimagetest.sh program.bbasic ...
+#  Checks flashimage against each program: building an image, listing it and building
+#  again must give the same image, compacting it must change nothing, and running the
+#  image must print what running the source does. Set BLUEBASIC and FLASHIMAGE to pick
+#  the binaries (the CMake build does this for ctest).
+
+work=$(mktemp -d "${TMPDIR:-/tmp}/flashimage.XXXXXX")
+trap "rm -rf $work" EXIT
+
+for program in "$@"
+do
+  name=$(basename $program .bbasic)
+  $FLASHIMAGE build $program $work/$name.img &&
+  $FLASHIMAGE list $work/$name.img $work/$name.bbasic &&
+  $FLASHIMAGE build $work/$name.bbasic $work/$name.again &&
+  $FLASHIMAGE compact $work/$name.img $work/$name.compact || exit 1
+  if ! cmp -s $work/$name.img $work/$name.again || ! cmp -s $work/$name.img $work/$name.compact
+  then
+    echo "** $name: FAILURE (images differ)"
+    exit 1
+  fi
+  # Both print the banner; loading the source prints NEW's OK as well
+  expected=$($BLUEBASIC -l $program -r)
+  result=$(cp $work/$name.img $work/$name.run && BLUEBASIC_FLASHSTORE=$work/$name.run $BLUEBASIC -r)
+  if [ "$(echo "$result" | sed '1,4d')" != "$(echo "$expected" | sed '1,5d')" ]
+  then
+    echo "** $name: FAILURE (output differs)"
+    diff <(echo "$expected" | sed '1,5d') <(echo "$result" | sed '1,4d')
+    exit 1
+  fi
+  echo "** $name: SUCCESS"
+done